@@ -0,0 +1,338 @@
+#include "bvh.h"
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <xmmintrin.h>
+
+#define BVH_BINS 12
+#define BVH_MAX_SAH_DEPTH 48 // deeper binary levels split at the median, bounding the tree depth
+#define BVH_STACK_SIZE 256
+
+// binary node of the SAH build, collapsed into BVHNodes afterwards
+struct BVHBuildNode {
+	glm::vec3 boundsMin, boundsMax;
+	int left, right; // -1 for a leaf holding item
+	int item;
+};
+
+/*-----------------------------------BUILD-------------------------------------*/
+
+static float surfaceArea(glm::vec3 boundsMin, glm::vec3 boundsMax) {
+	glm::vec3 d = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static int getBin(float centroid, float centroidMin, float extent) {
+	return std::min(BVH_BINS - 1, int((centroid - centroidMin) / extent * BVH_BINS));
+}
+
+static int buildRecursive(std::vector<BVHBuildNode>& build, std::vector<int>& order, int first, int count, int depth, const glm::vec3* boundsMin, const glm::vec3* boundsMax) {
+	BVHBuildNode node;
+	node.boundsMin = glm::vec3(FLT_MAX);
+	node.boundsMax = glm::vec3(-FLT_MAX);
+	node.left = node.right = -1;
+	node.item = order[first];
+	glm::vec3 centroidMin = glm::vec3(FLT_MAX);
+	glm::vec3 centroidMax = glm::vec3(-FLT_MAX);
+	for (int i = first; i < first + count; i++) {
+		node.boundsMin = glm::min(node.boundsMin, boundsMin[order[i]]);
+		node.boundsMax = glm::max(node.boundsMax, boundsMax[order[i]]);
+		glm::vec3 centroid = (boundsMin[order[i]] + boundsMax[order[i]]) * 0.5f;
+		centroidMin = glm::min(centroidMin, centroid);
+		centroidMax = glm::max(centroidMax, centroid);
+	}
+	int index = (int)build.size();
+	build.push_back(node);
+	if (count == 1) {
+		return index;
+	}
+
+	// cost of a split is the item count times the surface area of each side, over binned centroids
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestBin = 0;
+	for (int axis = 0; axis < 3 && depth < BVH_MAX_SAH_DEPTH; axis++) {
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f) {
+			continue;
+		}
+		glm::vec3 binMin[BVH_BINS], binMax[BVH_BINS];
+		int binCount[BVH_BINS];
+		for (int b = 0; b < BVH_BINS; b++) {
+			binMin[b] = glm::vec3(FLT_MAX);
+			binMax[b] = glm::vec3(-FLT_MAX);
+			binCount[b] = 0;
+		}
+		for (int i = first; i < first + count; i++) {
+			int item = order[i];
+			int b = getBin((boundsMin[item][axis] + boundsMax[item][axis]) * 0.5f, centroidMin[axis], extent);
+			binMin[b] = glm::min(binMin[b], boundsMin[item]);
+			binMax[b] = glm::max(binMax[b], boundsMax[item]);
+			binCount[b]++;
+		}
+		// right side of every split from a backwards sweep, then the left side going forwards
+		float rightArea[BVH_BINS];
+		int rightCount[BVH_BINS];
+		glm::vec3 sideMin = glm::vec3(FLT_MAX);
+		glm::vec3 sideMax = glm::vec3(-FLT_MAX);
+		int sideCount = 0;
+		for (int b = BVH_BINS - 1; b > 0; b--) {
+			sideMin = glm::min(sideMin, binMin[b]);
+			sideMax = glm::max(sideMax, binMax[b]);
+			sideCount += binCount[b];
+			rightArea[b] = surfaceArea(sideMin, sideMax);
+			rightCount[b] = sideCount;
+		}
+		sideMin = glm::vec3(FLT_MAX);
+		sideMax = glm::vec3(-FLT_MAX);
+		sideCount = 0;
+		for (int b = 0; b < BVH_BINS - 1; b++) {
+			sideMin = glm::min(sideMin, binMin[b]);
+			sideMax = glm::max(sideMax, binMax[b]);
+			sideCount += binCount[b];
+			if (sideCount == 0 || rightCount[b + 1] == 0) {
+				continue;
+			}
+			float cost = sideCount * surfaceArea(sideMin, sideMax) + rightCount[b + 1] * rightArea[b + 1];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	int mid = first + count / 2;
+	if (bestAxis >= 0) {
+		float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+		float minimum = centroidMin[bestAxis];
+		int* split = std::partition(&order[first], &order[first] + count, [&](int item) {
+			return getBin((boundsMin[item][bestAxis] + boundsMax[item][bestAxis]) * 0.5f, minimum, extent) <= bestBin;
+		});
+		mid = int(split - &order[0]);
+	}
+	else {
+		// coincident centroids or too deep, split at the median of the widest axis
+		glm::vec3 extent = centroidMax - centroidMin;
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+		std::nth_element(&order[first], &order[mid], &order[first] + count, [&](int a, int b) {
+			return boundsMin[a][axis] + boundsMax[a][axis] < boundsMin[b][axis] + boundsMax[b][axis];
+		});
+	}
+	int left = buildRecursive(build, order, first, mid - first, depth + 1, boundsMin, boundsMax);
+	int right = buildRecursive(build, order, mid, first + count - mid, depth + 1, boundsMin, boundsMax);
+	build[index].left = left;
+	build[index].right = right;
+	return index;
+}
+
+static void setChildBounds(BVHNode& node, int slot, glm::vec3 boundsMin, glm::vec3 boundsMax) {
+	node.minX[slot] = boundsMin.x;
+	node.minY[slot] = boundsMin.y;
+	node.minZ[slot] = boundsMin.z;
+	node.maxX[slot] = boundsMax.x;
+	node.maxY[slot] = boundsMax.y;
+	node.maxZ[slot] = boundsMax.z;
+}
+
+// Emits the 4-wide node for a binary subtree by opening its largest inner descendants until
+// the four slots are used, children are emitted after their parent.
+int BVH::collapse(const std::vector<BVHBuildNode>& build, int buildIndex) {
+	int slots[BVH_WIDTH];
+	int slotCount = 0;
+	if (build[buildIndex].left < 0) {
+		slots[slotCount++] = buildIndex;
+	}
+	else {
+		slots[slotCount++] = build[buildIndex].left;
+		slots[slotCount++] = build[buildIndex].right;
+	}
+	while (slotCount < BVH_WIDTH) {
+		int largest = -1;
+		float largestArea = -1.0f;
+		for (int s = 0; s < slotCount; s++) {
+			const BVHBuildNode& candidate = build[slots[s]];
+			float area = surfaceArea(candidate.boundsMin, candidate.boundsMax);
+			if (candidate.left >= 0 && area > largestArea) {
+				largest = s;
+				largestArea = area;
+			}
+		}
+		if (largest < 0) {
+			break;
+		}
+		int opened = slots[largest];
+		slots[largest] = build[opened].left;
+		slots[slotCount++] = build[opened].right;
+	}
+
+	int index = (int)nodes.size();
+	nodes.push_back(BVHNode());
+	for (int s = 0; s < BVH_WIDTH; s++) {
+		if (s >= slotCount) {
+			setChildBounds(nodes[index], s, glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX));
+			nodes[index].child[s] = BVH_EMPTY;
+			continue;
+		}
+		const BVHBuildNode& slot = build[slots[s]];
+		setChildBounds(nodes[index], s, slot.boundsMin, slot.boundsMax);
+		// collapse grows nodes, so index it again afterwards
+		int child = slot.left < 0 ? ~slot.item : collapse(build, slots[s]);
+		nodes[index].child[s] = child;
+	}
+	return index;
+}
+
+void BVH::build(const glm::vec3* boundsMin, const glm::vec3* boundsMax, int count) {
+	nodes.clear();
+	itemCount = count;
+	if (count == 0) {
+		return;
+	}
+	std::vector<int> order(count);
+	for (int i = 0; i < count; i++) {
+		order[i] = i;
+	}
+	std::vector<BVHBuildNode> binary;
+	binary.reserve(2 * count);
+	buildRecursive(binary, order, 0, count, 0, boundsMin, boundsMax);
+	nodes.reserve(count);
+	collapse(binary, 0);
+}
+
+void BVH::refit(const glm::vec3* boundsMin, const glm::vec3* boundsMax) {
+	// children come after their parents, so a backwards sweep refits them first
+	for (int n = (int)nodes.size() - 1; n >= 0; n--) {
+		BVHNode& node = nodes[n];
+		for (int s = 0; s < BVH_WIDTH; s++) {
+			int child = node.child[s];
+			if (child == BVH_EMPTY) {
+				continue;
+			}
+			if (child < 0) {
+				setChildBounds(node, s, boundsMin[~child], boundsMax[~child]);
+				continue;
+			}
+			const BVHNode& inner = nodes[child];
+			glm::vec3 innerMin = glm::vec3(FLT_MAX);
+			glm::vec3 innerMax = glm::vec3(-FLT_MAX);
+			for (int c = 0; c < BVH_WIDTH; c++) {
+				if (inner.child[c] != BVH_EMPTY) {
+					innerMin = glm::min(innerMin, glm::vec3(inner.minX[c], inner.minY[c], inner.minZ[c]));
+					innerMax = glm::max(innerMax, glm::vec3(inner.maxX[c], inner.maxY[c], inner.maxZ[c]));
+				}
+			}
+			setChildBounds(node, s, innerMin, innerMax);
+		}
+	}
+}
+
+/*-----------------------------------QUERIES-------------------------------------*/
+
+// visits the children in mask, pushing inner nodes and appending items
+static void visitChildren(const BVHNode& node, int mask, int* stack, int& top, std::vector<int>& result) {
+	for (int s = 0; s < BVH_WIDTH; s++) {
+		int child = node.child[s];
+		if (!(mask & (1 << s)) || child == BVH_EMPTY) {
+			continue;
+		}
+		if (child < 0) {
+			result.push_back(~child);
+		}
+		else {
+			stack[top++] = child;
+		}
+	}
+}
+
+void BVH::queryFrustum(const glm::vec4 planes[6], std::vector<int>& result) const {
+	if (nodes.empty()) {
+		return;
+	}
+	__m128 half = _mm_set1_ps(0.5f);
+	int stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const BVHNode& node = nodes[stack[--top]];
+		__m128 minX = _mm_loadu_ps(node.minX), maxX = _mm_loadu_ps(node.maxX);
+		__m128 minY = _mm_loadu_ps(node.minY), maxY = _mm_loadu_ps(node.maxY);
+		__m128 minZ = _mm_loadu_ps(node.minZ), maxZ = _mm_loadu_ps(node.maxZ);
+		__m128 cx = _mm_mul_ps(_mm_add_ps(minX, maxX), half), ex = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+		__m128 cy = _mm_mul_ps(_mm_add_ps(minY, maxY), half), ey = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+		__m128 cz = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half), ez = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(planes[p].x)), _mm_mul_ps(cy, _mm_set1_ps(planes[p].y))), _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+			__m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(fabsf(planes[p].x))), _mm_mul_ps(ey, _mm_set1_ps(fabsf(planes[p].y)))), _mm_mul_ps(ez, _mm_set1_ps(fabsf(planes[p].z))));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+		visitChildren(node, ~_mm_movemask_ps(outside) & 0xF, stack, top, result);
+	}
+}
+
+bool BVH::raycast(glm::vec3 origin, glm::vec3 direction, int& hitItem, float& hitDistance) const {
+	hitItem = -1;
+	hitDistance = FLT_MAX;
+	if (nodes.empty()) {
+		return false;
+	}
+	glm::vec3 invDirection = glm::vec3(1.0f) / direction;
+	__m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+	__m128 ix = _mm_set1_ps(invDirection.x), iy = _mm_set1_ps(invDirection.y), iz = _mm_set1_ps(invDirection.z);
+	int stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const BVHNode& node = nodes[stack[--top]];
+		// slab test, entry is the last plane crossed going in and exit the first going out
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), ox), ix), t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), ox), ix);
+		__m128 entry = _mm_min_ps(t0, t1), exit = _mm_max_ps(t0, t1);
+		t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), oy), iy);
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), oy), iy);
+		entry = _mm_max_ps(entry, _mm_min_ps(t0, t1));
+		exit = _mm_min_ps(exit, _mm_max_ps(t0, t1));
+		t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), oz), iz);
+		t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), oz), iz);
+		entry = _mm_max_ps(_mm_max_ps(entry, _mm_min_ps(t0, t1)), _mm_setzero_ps());
+		exit = _mm_min_ps(exit, _mm_max_ps(t0, t1));
+		__m128 hit = _mm_and_ps(_mm_cmple_ps(entry, exit), _mm_cmplt_ps(entry, _mm_set1_ps(hitDistance)));
+		int mask = _mm_movemask_ps(hit);
+		float entries[BVH_WIDTH];
+		_mm_storeu_ps(entries, entry);
+		for (int s = 0; s < BVH_WIDTH; s++) {
+			int child = node.child[s];
+			if (!(mask & (1 << s)) || child == BVH_EMPTY) {
+				continue;
+			}
+			if (child >= 0) {
+				stack[top++] = child;
+			}
+			else if (entries[s] < hitDistance) {
+				hitItem = ~child;
+				hitDistance = entries[s];
+			}
+		}
+	}
+	return hitItem >= 0;
+}
+
+void BVH::queryRange(glm::vec3 center, float radius, std::vector<int>& result) const {
+	if (nodes.empty()) {
+		return;
+	}
+	__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+	__m128 zero = _mm_setzero_ps();
+	int stack[BVH_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const BVHNode& node = nodes[stack[--top]];
+		// distance from the center to the closest point of each box
+		__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), cx), _mm_sub_ps(cx, _mm_loadu_ps(node.maxX))), zero);
+		__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), cy), _mm_sub_ps(cy, _mm_loadu_ps(node.maxY))), zero);
+		__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), cz), _mm_sub_ps(cz, _mm_loadu_ps(node.maxZ))), zero);
+		__m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		visitChildren(node, _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_set1_ps(radius * radius))), stack, top, result);
+	}
+}
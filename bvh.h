@@ -0,0 +1,41 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#define BVH_WIDTH 4 // children per node, one SSE register of each bound
+#define BVH_EMPTY (-2147483647 - 1) // unused child slot
+
+struct BVHBuildNode;
+
+// 4-wide node, the bounds of its children are stored one component per array so they are
+// tested together. child >= 0 is an inner node, otherwise ~child is an item index
+struct BVHNode {
+	float minX[BVH_WIDTH], minY[BVH_WIDTH], minZ[BVH_WIDTH];
+	float maxX[BVH_WIDTH], maxY[BVH_WIDTH], maxZ[BVH_WIDTH];
+	int child[BVH_WIDTH];
+};
+
+// Bounding volume hierarchy over item boxes. Built as a binary tree with the binned surface
+// area heuristic, then collapsed into 4-wide nodes kept in one array with the root first.
+struct BVH {
+	std::vector<BVHNode> nodes;
+	int itemCount = 0;
+
+	//! rebuild over count boxes, items are their indices
+	void build(const glm::vec3* boundsMin, const glm::vec3* boundsMax, int count);
+	//! update the node bounds after items moved, keeping the topology
+	void refit(const glm::vec3* boundsMin, const glm::vec3* boundsMax);
+	//! append the items whose boxes are not outside one of the inward facing planes
+	void queryFrustum(const glm::vec4 planes[6], std::vector<int>& result) const;
+	//! nearest item box hit by the ray, false when there is none
+	bool raycast(glm::vec3 origin, glm::vec3 direction, int& hitItem, float& hitDistance) const;
+	//! append the items whose boxes touch the sphere
+	void queryRange(glm::vec3 center, float radius, std::vector<int>& result) const;
+
+private:
+	int collapse(const std::vector<BVHBuildNode>& build, int buildIndex);
+};
+
+#endif
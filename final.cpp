@@ -1,635 +1,3530 @@
-﻿// Windows includes (For Time, IO, etc.)
-#include <windows.h>
-#include <mmsystem.h>
-#include <iostream>
-#include <string>
-#include <stdio.h>
-#include <math.h>
-#include <map>
-#include <vector> // STL dynamic memory.
-
-// OpenGL includes
-#include <GL/glew.h>
-#include <GL/freeglut.h>
-
-// Assimp includes
-#include <assimp/cimport.h> // scene importer
-#include <assimp/scene.h> // collects data
-#include <assimp/postprocess.h> // various extra operations
-
-//glm
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
-#include <glm/gtx/euler_angles.hpp>
-#include <glm/gtc/quaternion.hpp> 
-#include <glm/gtx/quaternion.hpp>
-
-// Project includes
-#include "maths_funcs.h"
-#define GLT_IMPLEMENTATION
-#include "gltext.h"
-
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb/stb_image.h"
-
-/*----------------------------------------------------------------------------
-MESH TO LOAD
-----------------------------------------------------------------------------*/
-// this mesh is a dae file format but you should be able to use any other format too, obj is typically what is used
-// put the mesh in your project directory, or provide a filepath for it here
-#define MESH_TEAPOT "./models/teapot.dae"
-#define MESH_BUNNY "./models/stanford-bunny.dae"
-#define MESH_SQUARE "./models/square.dae"
-#define MESH_BOARD "./models/board.dae"
-
-/*----------------------------------------------------------------------------
-----------------------------------------------------------------------------*/
-
-struct ModelData
-{
-	size_t mPointCount = 0;
-	std::vector<vec3> mVertices;
-	std::vector<vec3> mNormals;
-	std::vector<vec2> mTextureCoords;
-	std::vector<vec3> mTangents;
-	std::vector<vec3> mBitangents;
-};
-
-ModelData mesh_teapot;
-ModelData mesh_bunny;
-ModelData mesh_square;
-ModelData mesh_board;
-
-using namespace std;
-GLuint SkyBoxID, ShadowDepthID, ShadowMapID, BiasID, PCFID, PCSSID, VarianceID, VSSMID, MSMID, ShadowID;
-GLuint brickWallMap;
-
-unsigned int mesh_vao = 0;
-int width = 1600;
-int height = 1200;
-int mode = 1;
-
-glm::mat4 persp_proj = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 1000.0f);
-glm::mat4 view;
-
-// Camera pos
-GLfloat camera_pos_x = -13.0f;
-GLfloat camera_pos_z = 0.0f;
-GLfloat camera_pos_y = 0.0f;
-GLfloat camera_dir_x = -camera_pos_x;
-GLfloat camera_dir_z = -camera_pos_z;
-GLfloat camera_dir_y = -camera_pos_y;
-GLfloat light_pos_x = 10.0f;
-GLfloat light_pos_y = 5.0f;
-GLfloat light_pos_z = 0.0f;
-
-GLfloat pitch = 0.0f;
-GLfloat roll = 0.0f;
-GLfloat yaw = 0.0f;
-
-GLuint loc1, loc2, loc3, loc4, loc5;
-GLfloat rotate_x = 0.0f;
-GLfloat Delta = 2.0f;
-
-// shadow
-GLuint depthMapFBO = 0;
-GLuint depthMap;
-
-#pragma region MESH LOADING
-/*----------------------------------------------------------------------------
-MESH LOADING FUNCTION
-----------------------------------------------------------------------------*/
-
-ModelData load_mesh(const char* file_name) {
-	ModelData modelData;
-
-	const aiScene* scene = aiImportFile(
-		file_name,
-		aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_PreTransformVertices | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace
-	);
-
-	if (!scene) {
-		fprintf(stderr, "ERROR: reading mesh %s\n", file_name);
-		return modelData;
-	}
-
-	printf("  %i materials\n", scene->mNumMaterials);
-	printf("  %i meshes\n", scene->mNumMeshes);
-	printf("  %i textures\n", scene->mNumTextures);
-
-	for (unsigned int m_i = 0; m_i < scene->mNumMeshes; m_i++) {
-		const aiMesh* mesh = scene->mMeshes[m_i];
-		printf("    %i vertices in mesh\n", mesh->mNumVertices);
-		modelData.mPointCount += mesh->mNumVertices;
-		for (unsigned int v_i = 0; v_i < mesh->mNumVertices; v_i++) {
-			if (mesh->HasPositions()) {
-				const aiVector3D* vp = &(mesh->mVertices[v_i]);
-				modelData.mVertices.push_back(vec3(vp->x, vp->y, vp->z));
-			}
-			if (mesh->HasNormals()) {
-				const aiVector3D* vn = &(mesh->mNormals[v_i]);
-				modelData.mNormals.push_back(vec3(vn->x, vn->y, vn->z));
-			}
-			if (mesh->HasTextureCoords(0)) {
-				const aiVector3D* vt = &(mesh->mTextureCoords[0][v_i]);
-				modelData.mTextureCoords.push_back(vec2(vt->x, vt->y));
-			}
-			if (mesh->HasTangentsAndBitangents()) {
-				const aiVector3D* vta = &(mesh->mTangents[v_i]);
-				modelData.mTangents.push_back(vec3(vta->x, vta->y, vta->z));
-				const aiVector3D* vbt = &(mesh->mBitangents[v_i]);
-				modelData.mBitangents.push_back(vec3(vbt->x, vbt->y, vbt->z));
-			}
-		}
-	}
-	aiReleaseImport(scene);
-	return modelData;
-}
-
-#pragma endregion MESH LOADING
-
-// Shader Functions- click on + to expand
-#pragma region SHADER_FUNCTIONS
-char* readShaderSource(const char* shaderFile) {
-	FILE* fp;
-	fopen_s(&fp, shaderFile, "rb");
-
-	if (fp == NULL) { return NULL; }
-
-	fseek(fp, 0L, SEEK_END);
-	long size = ftell(fp);
-
-	fseek(fp, 0L, SEEK_SET);
-	char* buf = new char[size + 1];
-	fread(buf, 1, size, fp);
-	buf[size] = '\0';
-
-	fclose(fp);
-
-	return buf;
-}
-
-
-static void AddShader(GLuint ShaderProgram, const char* pShaderText, GLenum ShaderType)
-{
-	// create a shader object
-	GLuint ShaderObj = glCreateShader(ShaderType);
-
-	if (ShaderObj == 0) {
-		std::cerr << "Error creating shader..." << std::endl;
-		std::cerr << "Press enter/return to exit..." << std::endl;
-		std::cin.get();
-		exit(1);
-	}
-	const char* pShaderSource = readShaderSource(pShaderText);
-
-	// Bind the source code to the shader, this happens before compilation
-	glShaderSource(ShaderObj, 1, (const GLchar**)&pShaderSource, NULL);
-	// compile the shader and check for errors
-	glCompileShader(ShaderObj);
-	GLint success;
-	// check for shader related errors using glGetShaderiv
-	glGetShaderiv(ShaderObj, GL_COMPILE_STATUS, &success);
-	if (!success) {
-		GLchar InfoLog[1024] = { '\0' };
-		glGetShaderInfoLog(ShaderObj, 1024, NULL, InfoLog);
-		std::cerr << "Error compiling "
-			<< (ShaderType == GL_VERTEX_SHADER ? "vertex" : "fragment")
-			<< " shader program: " << InfoLog << std::endl;
-		std::cerr << "Press enter/return to exit..." << std::endl;
-		std::cin.get();
-		exit(1);
-	}
-	// Attach the compiled shader object to the program object
-	glAttachShader(ShaderProgram, ShaderObj);
-}
-
-GLuint CompileShaders(const char* vshadername, const char* fshadername)
-{
-	//Start the process of setting up our shaders by creating a program ID
-	//Note: we will link all the shaders together into this ID
-	GLuint shaderProgramID = glCreateProgram();
-	if (shaderProgramID == 0) {
-		std::cerr << "Error creating shader program..." << std::endl;
-		std::cerr << "Press enter/return to exit..." << std::endl;
-		std::cin.get();
-		exit(1);
-	}
-
-	// Create two shader objects, one for the vertex, and one for the fragment shader
-	AddShader(shaderProgramID, vshadername, GL_VERTEX_SHADER);
-	AddShader(shaderProgramID, fshadername, GL_FRAGMENT_SHADER);
-
-	GLint Success = 0;
-	GLchar ErrorLog[1024] = { '\0' };
-	// After compiling all shader objects and attaching them to the program, we can finally link it
-	glLinkProgram(shaderProgramID);
-	// check for program related errors using glGetProgramiv
-	glGetProgramiv(shaderProgramID, GL_LINK_STATUS, &Success);
-	if (Success == 0) {
-		glGetProgramInfoLog(shaderProgramID, sizeof(ErrorLog), NULL, ErrorLog);
-		std::cerr << "Error linking shader program: " << ErrorLog << std::endl;
-		std::cerr << "Press enter/return to exit..." << std::endl;
-		std::cin.get();
-		exit(1);
-	}
-
-	// program has been successfully linked but needs to be validated to check whether the program can execute given the current pipeline state
-	glValidateProgram(shaderProgramID);
-	// check for program related errors using glGetProgramiv
-	glGetProgramiv(shaderProgramID, GL_VALIDATE_STATUS, &Success);
-	if (!Success) {
-		glGetProgramInfoLog(shaderProgramID, sizeof(ErrorLog), NULL, ErrorLog);
-		std::cerr << "Invalid shader program: " << ErrorLog << std::endl;
-		std::cerr << "Press enter/return to exit..." << std::endl;
-		std::cin.get();
-		exit(1);
-	}
-	// Finally, use the linked shader program
-	// Note: this program will stay in effect for all draw calls until you replace it with another or explicitly disable its use
-	glUseProgram(shaderProgramID);
-	return shaderProgramID;
-}
-#pragma endregion SHADER_FUNCTIONS
-
-unsigned int loadTexture(const char* texture) {
-	unsigned int vto = 0;
-	glGenTextures(1, &vto);
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(texture, &width, &height, &nrComponents, 0);
-	GLenum format = GL_RGB;
-	if (nrComponents == 1)
-		format = GL_RED;
-	else if (nrComponents == 3)
-		format = GL_RGB;
-	else if (nrComponents == 4)
-		format = GL_RGBA;
-	glBindTexture(GL_TEXTURE_2D, vto);
-	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	stbi_image_free(data);
-	return vto;
-}
-
-// VBO Functions - click on + to expand
-#pragma region VBO_FUNCTIONS
-void generateObjectBufferMesh(GLuint& ID, ModelData mesh_data) {
-	loc1 = glGetAttribLocation(ID, "vertex_position");
-	loc2 = glGetAttribLocation(ID, "vertex_normal");
-	loc3 = glGetAttribLocation(ID, "vertex_texture");
-	loc4 = glGetAttribLocation(ID, "aTangent");
-	loc5 = glGetAttribLocation(ID, "aBitangent");
-
-	unsigned int vp_vbo = 0;
-	glGenBuffers(1, &vp_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vp_vbo);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data.mPointCount * sizeof(vec3), &mesh_data.mVertices[0], GL_STATIC_DRAW);
-	unsigned int vn_vbo = 0;
-	glGenBuffers(1, &vn_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vn_vbo);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data.mPointCount * sizeof(vec3), &mesh_data.mNormals[0], GL_STATIC_DRAW);
-	unsigned int vt_vbo = 0;
-	glGenBuffers(1, &vt_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vt_vbo);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data.mPointCount * sizeof(vec2), &mesh_data.mTextureCoords[0], GL_STATIC_DRAW);
-	unsigned int va_vbo = 0;
-	glGenBuffers(1, &va_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, va_vbo);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data.mPointCount * sizeof(vec3), &mesh_data.mTangents[0], GL_STATIC_DRAW);
-	unsigned int vb_vbo = 0;
-	glGenBuffers(1, &vb_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vb_vbo);
-	glBufferData(GL_ARRAY_BUFFER, mesh_data.mPointCount * sizeof(vec3), &mesh_data.mBitangents[0], GL_STATIC_DRAW);
-
-	unsigned int vao = 0;
-	glBindVertexArray(vao);
-
-	glEnableVertexAttribArray(loc1);
-	glBindBuffer(GL_ARRAY_BUFFER, vp_vbo);
-	glVertexAttribPointer(loc1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(loc2);
-	glBindBuffer(GL_ARRAY_BUFFER, vn_vbo);
-	glVertexAttribPointer(loc2, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(loc3);
-	glBindBuffer(GL_ARRAY_BUFFER, vt_vbo);
-	glVertexAttribPointer(loc3, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(loc4);
-	glBindBuffer(GL_ARRAY_BUFFER, va_vbo);
-	glVertexAttribPointer(loc4, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(loc5);
-	glBindBuffer(GL_ARRAY_BUFFER, vb_vbo);
-	glVertexAttribPointer(loc5, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-}
-
-void generateDepthMap() {
-	glGenFramebuffers(1, &depthMapFBO);
-	glGenTextures(1, &depthMap);
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 1024, 1024, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-	//glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
-GLuint varianceFBO[2];
-GLuint varianceTexture[2];
-GLuint depthMapFBO2 = 0;
-GLuint depthMap2;
-void generateVarianceMap() {
-	glGenTextures(1, &depthMap2);
-	glBindTexture(GL_TEXTURE_2D, depthMap2);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, 1024, 1024, 0, GL_RG, GL_FLOAT,NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, depthMap2, 0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	glGenFramebuffers(2, varianceFBO);
-	glGenTextures(2, varianceTexture);
-	for (int i = 0; i < 2; i++)
-	{
-		glBindFramebuffer(GL_FRAMEBUFFER, varianceFBO[i]);
-		glBindTexture(GL_TEXTURE_2D, varianceTexture[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, 1024, 1024, 0, GL_RG, GL_FLOAT, nullptr);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, varianceTexture[i], 0);
-	}
-}
-
-#pragma endregion VBO_FUNCTIONS
-
-void drawText(const char* str, GLfloat size, glm::vec3 pos) {
-	// Initialize glText
-	gltInit();
-	// Creating text
-	GLTtext* text = gltCreateText();
-	gltSetText(text, str);
-	// Begin text drawing (this for instance calls glUseProgram)
-	gltBeginDraw();
-	// Draw any amount of text between begin and end
-	gltColor(1.0f, 1.0f, 1.0f, 1.0f);
-	gltDrawText2DAligned(text, 70 * (pos.x + 1), 450 - pos.y * 70, size, GLT_CENTER, GLT_CENTER);
-	// Finish drawing text
-	gltEndDraw();
-	// Deleting text
-	gltDeleteText(text);
-	// Destroy glText
-	gltTerminate();
-}
-
-unsigned int quadVAO = 0;
-unsigned int quadVBO;
-void renderQuad()
-{
-	if (quadVAO == 0)
-	{
-		float quadVertices[] = {
-			// position        // uv
-			-1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-			-1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
-			1.0f, 1.0f, 0.0f, 1.0f, 1.0f,
-			1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
-		};
-		glGenVertexArrays(1, &quadVAO);
-		glGenBuffers(1, &quadVBO);
-		glBindVertexArray(quadVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	}
-	glBindVertexArray(quadVAO);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
-}
-
-void displayNormalObject(GLuint& ID, glm::vec3 pos, ModelData mesh_data, GLuint type, float scale) {
-	generateObjectBufferMesh(ID, mesh_data);
-	glm::mat4 model = glm::mat4(1.0f);
-	model = glm::translate(model, pos);
-	model = glm::scale(model, glm::vec3(scale, scale, scale));
-	if (type == 1) {
-		model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-		model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	}
-	else if (type == 2) {
-		model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	}
-
-	glUniformMatrix4fv(glGetUniformLocation(ID, "model"), 1, GL_FALSE, &model[0][0]);
-	glDrawArrays(GL_TRIANGLES, 0, mesh_data.mPointCount);
-}
-
-void display() {
-	//rotate_x += Delta;
-	//camera_pos_x = 10.0f * cos(glm::radians(rotate_x));
-	//camera_pos_z = 10.0f * sin(glm::radians(rotate_x));
-
-	view = glm::lookAt(glm::vec3(camera_pos_x, camera_pos_y, camera_pos_z), // Camera is at (x,y,z), in World Space
-		   glm::vec3(0, 0, 0), // and looks at the origin 
-		   glm::vec3(0, 1, 0));  // Head is up (set to 0,-1,0 to look upside-down)
-	glm::mat4 lightProjection = glm::ortho(-15.0f, 25.0f, -8.0f, 8.0f, -15.0f, 25.0f);
-	glm::mat4 lightView = glm::lookAt(glm::vec3(light_pos_x, light_pos_y, light_pos_z), glm::vec3(0.0f), glm::vec3(1.0));
-	glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-
-	if (mode != 5) {
-		// 1. get depth map
-		glViewport(0, 0, 1024, 1024);
-		glUseProgram(ShadowDepthID);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glEnable(GL_DEPTH_TEST);
-		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-
-		glUniformMatrix4fv(glGetUniformLocation(ShadowDepthID, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
-		displayNormalObject(ShadowDepthID, glm::vec3(0.0f, -0.5f, 2.5f), mesh_teapot, 1, 0.2f);
-		displayNormalObject(ShadowDepthID, glm::vec3(0.0f, -1.0f, -3.0f), mesh_bunny, 2, 1.0f);
-		displayNormalObject(ShadowDepthID, glm::vec3(-3.0f, -1.0f, 0.0f), mesh_teapot, 1, 0.1f);
-		displayNormalObject(ShadowDepthID, glm::vec3(-5.0f, -2.0f, 0.0f), mesh_board, 2, 0.2f);
-	}
-	else {
-		glViewport(0, 0, 1024, 1024);
-		glUseProgram(ShadowDepthID);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO2);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glEnable(GL_DEPTH_TEST);
-		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-
-		glUniformMatrix4fv(glGetUniformLocation(ShadowDepthID, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
-		displayNormalObject(ShadowDepthID, glm::vec3(0.0f, -0.5f, 2.5f), mesh_teapot, 1, 0.2f);
-		displayNormalObject(ShadowDepthID, glm::vec3(0.0f, -1.0f, -3.0f), mesh_bunny, 2, 1.0f);
-		displayNormalObject(ShadowDepthID, glm::vec3(-3.0f, -1.0f, 0.0f), mesh_teapot, 1, 0.1f);
-		//displayNormalObject(ShadowDepthID, glm::vec3(-5.0f, -1.0f, -3.0f), mesh_bunny, 2, 0.5f);
-		displayNormalObject(ShadowDepthID, glm::vec3(-5.0f, -2.0f, 0.0f), mesh_board, 2, 0.2f);
-
-		// calculate the average value
-		glBindFramebuffer(GL_FRAMEBUFFER, varianceFBO[0]);
-		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, depthMap2);
-		glUseProgram(VarianceID);
-		glUniform1f(glGetUniformLocation(VarianceID, "vertical"), 0.0f);
-		renderQuad();
-
-		glBindFramebuffer(GL_FRAMEBUFFER, varianceFBO[1]);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, varianceTexture[0]);
-		glUniform1f(glGetUniformLocation(VarianceID, "vertical"), 1.0f);
-		renderQuad();
-	}
-
-	// 2. render scene
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, 1600, 1200);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glUseProgram(ShadowID);
-	//lightSpaceMatrix = lightProjection * view;
-	glUniformMatrix4fv(glGetUniformLocation(ShadowID, "proj"), 1, GL_FALSE, &persp_proj[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(ShadowID, "view"), 1, GL_FALSE, &view[0][0]);
-	glUniform3f(glGetUniformLocation(ShadowID, "viewPos"), camera_pos_x, camera_pos_y, camera_pos_z);
-	glUniform3f(glGetUniformLocation(ShadowID, "lightPos"), light_pos_x, light_pos_y, light_pos_z);
-	glUniformMatrix4fv(glGetUniformLocation(ShadowID, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
-
-	glActiveTexture(GL_TEXTURE0);
-	if (mode == 5) { glBindTexture(GL_TEXTURE_2D, varianceTexture[1]); }
-	else { glBindTexture(GL_TEXTURE_2D, depthMap); }
-	
-	displayNormalObject(ShadowID, glm::vec3(0.0f, -0.5f, 2.5f), mesh_teapot, 1, 0.2f);
-	displayNormalObject(ShadowID, glm::vec3(0.0f, -1.0f, -3.0f), mesh_bunny, 2, 1.0f);
-	displayNormalObject(ShadowID, glm::vec3(-3.0f, -1.0f, 0.0f), mesh_teapot, 1, 0.1f);
-	//displayNormalObject(ShadowID, glm::vec3(-5.0f, -1.0f, -3.0f), mesh_bunny, 2, 0.5f);
-	displayNormalObject(ShadowID, glm::vec3(-5.0f, -2.0f, 0.0f), mesh_board, 2, 0.2f);
-
-	if (mode == 1) { drawText("Basic Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
-	else if (mode == 2) { drawText("Basic Shadow with bias", 5, glm::vec3(10.0f, 4.0f, 0.0f)); }
-	else if (mode == 3) { drawText("PCF Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
-	else if (mode == 4) { drawText("PCSS Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
-	else if (mode == 5) { drawText("VSSM Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
-	else if (mode == 6) { drawText("MSM Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
-	glutPostRedisplay();
-	glutSwapBuffers();
-}
-
-void init()
-{
-	mesh_teapot = load_mesh(MESH_TEAPOT);
-	mesh_bunny = load_mesh(MESH_BUNNY);
-	mesh_square = load_mesh(MESH_SQUARE);
-	mesh_board = load_mesh(MESH_BOARD);
-	brickWallMap = loadTexture("./textures/brickwall.jpg");
-	SkyBoxID = CompileShaders("./shaders/skyboxVertexShader.txt", "./shaders/skyboxFragmentShader.txt");
-	ShadowDepthID = CompileShaders("./shaders/shadowDepthVertexShader.txt", "./shaders/shadowDepthFragmentShader.txt");
-	ShadowMapID = CompileShaders("./shaders/shadowVertexShader.txt", "./shaders/shadowFragmentShader.txt");
-	BiasID = CompileShaders("./shaders/shadowVertexShader.txt", "./shaders/shadowBiasFragmentShader.txt");
-	PCFID = CompileShaders("./shaders/shadowVertexShader.txt", "./shaders/shadowPCFFragmentShader.txt");
-	PCSSID = CompileShaders("./shaders/shadowVertexShader.txt", "./shaders/shadowPCSSFragmentShader.txt");
-	VarianceID = CompileShaders("./shaders/shadowDD2VertexShader.txt", "./shaders/shadowDD2FragmentShader.txt");
-	VSSMID = CompileShaders("./shaders/shadowVertexShader.txt", "./shaders/shadowVSSMFragmentShader.txt");
-	MSMID = CompileShaders("./shaders/shadowVertexShader.txt", "./shaders/shadowMSMFragmentShader.txt");
-	ShadowID = ShadowMapID;
-	generateDepthMap();
-	generateVarianceMap();
-}
-
-// Placeholder code for the keypress
-void keypress(unsigned char key, int x, int y) {
-	if (key == '1') {
-		ShadowID = ShadowMapID;
-		mode = 1;
-	}
-	else if (key == '2') {
-		ShadowID = BiasID;
-		mode = 2;
-	}
-	else if (key == '3') {
-		ShadowID = PCFID;
-		mode = 3;
-	}
-	else if (key == '4') {
-		ShadowID = PCSSID;
-		mode = 4;
-	}
-	else if (key == '5') {
-		ShadowID = VSSMID;
-		mode = 5;
-	}
-	else if (key == '6') {
-		ShadowID = MSMID;
-		mode = 6;
-	}
-}
-
-void mousePress(int button, int state, int xpos, int ypos) {
-	// Wheel reports as button 3(scroll up) and button 4(scroll down)
-	if (button == 3) // It's a wheel event
-	{
-		// Each wheel event reports like a button click, GLUT_DOWN then GLUT_UP
-		if (state == GLUT_UP) return; // Disregard redundant GLUT_UP events
-		printf("Scroll %s At %d %d\n", (button == 3) ? "Up" : "Down", xpos, ypos);
-		camera_pos_x += 1.0f;
-	}
-	else if (button == 4)
-	{
-		if (state == GLUT_UP) return; // Disregard redundant GLUT_UP events
-		printf("Scroll %s At %d %d\n", (button == 3) ? "Up" : "Down", xpos, ypos);
-		camera_pos_x -= 1.0f;
-	}
-	else if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {  // normal button event
-		yaw += (xpos - float(width) / 2.0) / width;
-		yaw = glm::mod(yaw + 180.0f, 360.0f) - 180.0f;
-		pitch -= (ypos - float(height) / 2.0) / height;
-		pitch = glm::clamp(pitch, -89.0f, 89.0f);
-		//glutWarpPointer(width / 2.0, height / 2.0);	
-		camera_dir_x = cos(pitch) * sin(yaw);
-		camera_dir_y = sin(pitch);
-		camera_dir_z = -cos(pitch) * cos(yaw);
-	}
-}
-
-int main(int argc, char** argv) {
-	// Set up the window
-	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
-	glutInitWindowSize(width, height);
-	glutCreateWindow("shadow");
-
-	//texure
-	glEnable(GL_DEPTH_TEST);
-
-	// Tell glut where the display function is
-	glutDisplayFunc(display);
-	glutKeyboardFunc(keypress);
-	glutMouseFunc(mousePress);
-	//glutMotionFunc(mouseMotion);
-
-	// A call to glewInit() must be done after glut is initialized!
-	GLenum res = glewInit();
-	// Check for any errors
-	if (res != GLEW_OK) {
-		fprintf(stderr, "Error: '%s'\n", glewGetErrorString(res));
-		return 1;
-	}
-	// Set up your objects and shaders
-	init();
-	// Begin infinite event loop
-	glutMainLoop();
-	return 0;
+﻿// Windows includes (For Time, IO, etc.)
+#include <windows.h>
+#include <mmsystem.h>
+#include <iostream>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <map>
+#include <algorithm>
+#include <vector> // STL dynamic memory.
+#ifdef __AVX__
+#include <immintrin.h> // 8-wide frustum culling
+#else
+#include <xmmintrin.h>
+#endif
+
+// OpenGL includes
+#include <GL/glew.h>
+#include <GL/freeglut.h>
+
+// Assimp includes
+#include <assimp/cimport.h> // scene importer
+#include <assimp/scene.h> // collects data
+#include <assimp/postprocess.h> // various extra operations
+
+//glm
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/euler_angles.hpp>
+#include <glm/gtc/quaternion.hpp> 
+#include <glm/gtx/quaternion.hpp>
+
+// Project includes
+#include "maths_funcs.h"
+#include "bvh.h"
+#define GLT_IMPLEMENTATION
+#include "gltext.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+/*----------------------------------------------------------------------------
+MESH TO LOAD
+----------------------------------------------------------------------------*/
+// this mesh is a dae file format but you should be able to use any other format too, obj is typically what is used
+// put the mesh in your project directory, or provide a filepath for it here
+#define MESH_TEAPOT "./models/teapot.dae"
+#define MESH_BUNNY "./models/stanford-bunny.dae"
+#define MESH_SQUARE "./models/square.dae"
+#define MESH_BOARD "./models/board.dae"
+
+/*----------------------------------------------------------------------------
+----------------------------------------------------------------------------*/
+
+struct ModelData
+{
+	size_t mPointCount = 0;
+	std::vector<vec3> mVertices;
+	std::vector<vec3> mNormals;
+	std::vector<vec2> mTextureCoords;
+	std::vector<vec3> mTangents;
+	std::vector<vec3> mBitangents;
+	GLuint mVBO[5] = { 0, 0, 0, 0, 0 };
+	glm::vec3 mBoundsMin = glm::vec3(0.0f);
+	glm::vec3 mBoundsMax = glm::vec3(0.0f);
+};
+
+ModelData mesh_teapot;
+ModelData mesh_bunny;
+ModelData mesh_square;
+ModelData mesh_board;
+
+struct SceneObject
+{
+	ModelData* mesh;
+	glm::vec3 pos;
+	GLuint type;
+	float scale;
+	bool dynamic; // moved by animateScene, drawn over the cached static shadow layer
+	glm::vec3 anchor;
+	// world space, refreshed by updateObjectBounds every frame
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+	glm::vec4 boundingSphere = glm::vec4(0.0f); // center, radius
+};
+
+std::vector<SceneObject> sceneObjects;
+
+using namespace std;
+GLuint SkyBoxID, ShadowDepthID, PointDepthID, ShadowMapID, BiasID, PCFID, PCSSID, VarianceID, VSSMID, MSMID, HWPCFID, GatherPCSSID, ShadowID, DepthReduceID, MinMaxID, SATID, MSMDepthID, ExpDepthID, ESMID, BlurComputeID, PenumbraMaskID, PenumbraDilateID, DepthPrePassID, MaskUpsampleID, TemporalID, HiZID, HiZTestID;
+GLuint brickWallMap;
+
+unsigned int mesh_vao = 0;
+int width = 1600;
+int height = 1200;
+int mode = 1;
+
+GLfloat camera_near = 0.1f;
+GLfloat camera_far = 1000.0f;
+glm::mat4 persp_proj = glm::perspective(45.0f, 4.0f / 3.0f, camera_near, camera_far);
+glm::mat4 view;
+
+// Camera pos
+GLfloat camera_pos_x = -13.0f;
+GLfloat camera_pos_z = 0.0f;
+GLfloat camera_pos_y = 0.0f;
+GLfloat camera_dir_x = -camera_pos_x;
+GLfloat camera_dir_z = -camera_pos_z;
+GLfloat camera_dir_y = -camera_pos_y;
+GLfloat light_pos_x = 10.0f;
+GLfloat light_pos_y = 5.0f;
+GLfloat light_pos_z = 0.0f;
+
+GLfloat pitch = 0.0f;
+GLfloat roll = 0.0f;
+GLfloat yaw = 0.0f;
+
+GLuint loc1, loc2, loc3, loc4, loc5;
+GLfloat rotate_x = 0.0f;
+GLfloat Delta = 2.0f;
+bool animateObjects = false;
+GLfloat animation_angle = 0.0f;
+#define ANIMATION_RADIUS 1.0f // dynamic objects circle their anchor
+
+// shadow
+#define SHADOW_MAP_SIZE 1024
+#define MAX_CASCADES 4
+GLuint depthMapFBO = 0;
+GLuint depthMap; // texture array, one layer per cascade
+
+// cascaded shadow maps, cascadeCount 1 keeps the single whole scene projection
+int cascadeCount = 1;
+GLfloat shadowDistance = 30.0f; // camera distance covered by the cascades
+GLfloat cascadeSplitLambda = 0.75f; // practical split scheme, 0 = uniform, 1 = logarithmic
+GLfloat cascadeBlendBand = 0.1f; // part of each cascade cross-faded into the next one
+glm::mat4 cascadeMatrices[MAX_CASCADES];
+glm::vec2 cascadeDepthRanges[MAX_CASCADES]; // near/far of each cascade projection, distance from the light
+GLfloat cascadeSplits[MAX_CASCADES];
+
+// whole scene light projection, fitted every frame in updateLightProjection
+glm::mat4 lightSpaceMatrix;
+
+// shadow casters are culled against each light volume, and with full updates also when their
+// shadow cannot reach the camera frustum; the kernels reach this far past the visible receivers
+#define CULL_MARGIN_TEXELS 64
+bool casterCullingEnabled = true;
+int castersDrawn = 0; // over every shadow pass of the frame
+int castersCulled = 0;
+struct CasterCullVolume
+{
+	glm::mat4 lightMatrix;
+	glm::vec4 planes[6];
+	bool swept; // test the shadow of the caster against the camera slice too
+	glm::vec3 sliceMin, sliceMax; // camera slice in the light's clip space
+};
+
+// camera frustum culling of the passes drawn from the camera, objects are tested 4 at a time
+// with SSE, or 8 with AVX, against bounds laid out one component per array
+#define CULL_PASS_PREPASS 0
+#define CULL_PASS_LIT 1
+#define CULL_PASS_PENUMBRA 2
+#define CULL_PASS_COUNT 3
+#ifdef __AVX__
+#define CULL_WIDTH 8
+#else
+#define CULL_WIDTH 4
+#endif
+struct CullCounters
+{
+	int drawn;
+	int culled;
+	int retested; // drawn under conditional rendering after the hierarchical-z retest or an occlusion query
+};
+bool frustumCullingEnabled = true;
+CullCounters cullCounters[CULL_PASS_COUNT];
+// box centers and half extents, padded to a multiple of CULL_WIDTH
+std::vector<float> cullCenterX, cullCenterY, cullCenterZ;
+std::vector<float> cullExtentX, cullExtentY, cullExtentZ;
+std::vector<char> objectInFrustum;
+// frustum culling walks the hierarchy instead of the flat arrays from this many objects on
+#define BVH_MIN_OBJECTS 256
+BVH sceneBVH;
+glm::vec2 lightDepthRange;
+
+// shadow map caching, static casters live in their own copy that is only re-rendered when the
+// light projection or a static caster changes, dynamic casters are drawn over it each frame
+#define CASTERS_ALL 0
+#define CASTERS_STATIC 1
+#define CASTERS_DYNAMIC 2
+struct ShadowCache
+{
+	glm::mat4 matrices[MAX_CASCADES];
+	int layers = 0;
+	std::vector<glm::mat4> models;
+	std::vector<glm::mat4> previousModels; // transforms before the last check, for partial updates
+	bool lightChanged = true;
+	bool valid = false;
+};
+// full: re-render every frame, cached: static layer + dynamic overlay,
+// partial: clear and redraw only the texels a moving caster left or entered
+#define SHADOW_UPDATE_FULL 0
+#define SHADOW_UPDATE_CACHED 1
+#define SHADOW_UPDATE_PARTIAL 2
+int shadowUpdateMode = SHADOW_UPDATE_CACHED;
+std::string shadowUpdateStatus;
+ShadowCache depthMapCache;
+ShadowCache momentMapCache;
+GLuint staticDepthMapFBO = 0;
+GLuint staticDepthMap;
+GLuint staticMomentFBO = 0;
+GLuint staticMomentMap;
+GLuint staticMomentRBO;
+
+// spot lights whose shadow maps share one depth atlas, tiles are sized by screen importance
+#define SHADOW_ATLAS_SIZE 4096
+#define ATLAS_MIN_TILE 64
+#define ATLAS_MAX_TILE 1024
+#define MAX_ATLAS_LIGHTS 32
+#define ATLAS_LIGHTS_BINDING 0
+struct SpotLight
+{
+	glm::vec3 position;
+	glm::vec3 direction;
+	glm::vec3 color;
+	float angle; // cone half angle in degrees
+	float range;
+};
+// std140 layout of one entry in the AtlasLights uniform block
+struct AtlasLightBlock
+{
+	glm::mat4 matrix;
+	glm::vec4 rect; // atlas uv x, y, width, height, zero width means no shadow map
+	glm::vec4 position; // w = range
+	glm::vec4 direction; // w = cos of the cone half angle
+	glm::vec4 color;
+};
+struct AtlasShelf
+{
+	int y;
+	int height;
+	int x; // next free column
+};
+std::vector<SpotLight> spotLights;
+int atlasLightCount = 0;
+GLuint shadowAtlasFBO = 0;
+GLuint shadowAtlas;
+GLuint atlasLightsUBO;
+glm::mat4 atlasLightMatrices[MAX_ATLAS_LIGHTS];
+glm::ivec4 atlasLightRects[MAX_ATLAS_LIGHTS]; // texels x, y, size, size
+int atlasUnshadowedLights = 0; // visible lights that got no tile, only when even the smallest tiles don't fit
+
+// point lights, all six faces of every light render in one layered pass into a cube map array
+#define POINT_SHADOW_SIZE 512
+#define MAX_POINT_LIGHTS 4
+struct PointLight
+{
+	glm::vec3 position;
+	glm::vec3 color;
+	float range; // far plane of the cube, distances are stored divided by it
+};
+std::vector<PointLight> pointLights;
+int pointLightCount = 0;
+GLuint pointShadowFBO = 0;
+GLuint pointShadowMaps; // cube map array, layer = light * 6 + face
+int pointFacesDrawn = 0;
+// cube map arrays need GL 4.0, without them the point lights are lit but unshadowed
+bool pointShadowsSupported = false;
+
+// hardware PCF reads the depth array through a compare sampler on unit 3
+GLuint shadowCompareSampler;
+int pcfKernelSize = 7;
+// gpu time per pass from timestamps, kept for a few frames and read back only once available
+#define GPU_TIMER_FRAMES 3
+#define GPU_TIMER_START 0
+#define GPU_TIMER_SHADOWS 1 // directional depth or moment maps
+#define GPU_TIMER_LIGHTS 2 // spot light atlas and point light cubes
+#define GPU_TIMER_PREPASS 3 // penumbra mask, depth pre-pass and screen shadow mask
+#define GPU_TIMER_LIT 4
+#define GPU_TIMESTAMPS 5
+GLuint gpuTimerQueries[GPU_TIMER_FRAMES][GPU_TIMESTAMPS];
+bool gpuTimerPending[GPU_TIMER_FRAMES] = { false, false, false };
+int gpuTimerFrame = 0;
+bool gpuTimerRecording = false;
+float gpuPassTimes[GPU_TIMESTAMPS - 1] = { 0.0f, 0.0f, 0.0f, 0.0f };
+// adaptive PCF probes a ring first and skips the kernel where all probes agree
+// PCF_PROBES and the tap budgets of shadowAdaptivePCF.txt, for the HUD
+#define ADAPTIVE_PROBES 8
+#define ADAPTIVE_MAX_RADIUS 8
+#define ADAPTIVE_MAX_PENUMBRA 16
+bool adaptivePCFEnabled = true;
+// early lit, early shadowed and full kernel lookups counted by the lit pass, needs GL 4.2 atomic counters
+bool pcfCountersSupported = false;
+bool pcfCountersEnabled = false;
+GLuint pcfCounterBuffer = 0;
+GLuint pcfCounts[3] = { 0, 0, 0 };
+
+// min/max depth pyramid over the cascades, lets PCSS skip fully lit and fully occluded fragments
+#define MIN_MAX_SIZE (SHADOW_MAP_SIZE / 2)
+#define MIN_MAX_LEVELS 9 // 512 down to 2x2
+bool minMaxEnabled = true;
+bool minMaxValid = false;
+GLuint minMaxFBO = 0;
+GLuint shadowMinMaxMap;
+
+// MSM keeps four moments of a single light map in RGBA16, quantized so 16 bits are enough
+ShadowCache msmMapCache;
+GLuint msmFBO = 0;
+GLuint msmMap;
+GLuint msmRBO;
+GLuint msmStaticFBO = 0;
+GLuint msmStaticMap;
+GLuint msmStaticRBO;
+GLuint msmBlurFBO[2];
+GLuint msmBlurTexture[2];
+
+// ESM (mode 9) and EVSM (mode 10) share one set of targets and the ping-pong blur
+#define ESM_MAX_EXPONENT_16 10.0f // exp(c) must stay below the half float maximum
+#define EVSM_MAX_EXPONENT_16 5.54f // EVSM also stores exp(2c)
+#define ESM_MAX_EXPONENT_32 88.0f // same for the float maximum
+#define EVSM_MAX_EXPONENT_32 44.0f
+#define EXP_MIN_EXPONENT 0.5f
+ShadowCache expMapCache;
+int expMapMode = 0; // mode whose warp the exponential targets hold
+bool expPrecision32 = true;
+// ESM, positive and negative EVSM exponents, kept per precision so each starts at and is tuned within its own range
+glm::vec3 expExponents[2] = { glm::vec3(ESM_MAX_EXPONENT_16, EVSM_MAX_EXPONENT_16, 5.0f), glm::vec3(80.0f, 40.0f, 5.0f) };
+GLuint expFBO = 0;
+GLuint expMap;
+GLuint expRBO;
+GLuint expStaticFBO = 0;
+GLuint expStaticMap;
+GLuint expStaticRBO;
+GLuint expBlurFBO[2];
+GLuint expBlurTexture[2]; // [1] is mipmapped and filtered anisotropically
+
+// moment map blur, a GL 4.3 compute path with the fragment passes as the GL 3.3 fallback
+#define BLUR_SEGMENT 256 // texels per compute workgroup, THREADS * TEXELS_PER_THREAD in the shader
+#define MAX_BLUR_RADIUS 16
+bool computeBlurSupported = false;
+bool computeBlurEnabled = false;
+int blurRadius = 5;
+
+// PCF and PCSS sampling, a dense grid or a rotated disk pattern with a fixed sample count
+#define SAMPLE_GRID 0
+#define SAMPLE_POISSON 1
+#define SAMPLE_VOGEL 2
+#define SAMPLE_VARIANTS 3
+#define BLUE_NOISE_SIZE 64
+const int sampleCounts[SAMPLE_VARIANTS] = { 8, 16, 32 };
+int samplePattern = SAMPLE_GRID;
+int sampleCountIndex = 1;
+// the count is compiled in, so every count has its own program
+GLuint PCFVariants[SAMPLE_VARIANTS];
+GLuint PCSSVariants[SAMPLE_VARIANTS];
+GLuint blueNoiseTexture;
+
+// summed-area table over the VSSM moments, built by recursive doubling
+bool satEnabled = true;
+GLuint satFBO[2];
+GLuint satTexture[2];
+int satResult = 0; // which of the two holds the finished table
+
+// camera view is rendered off screen so its depth buffer can be sampled
+GLuint sceneFBO = 0;
+GLuint sceneColor;
+GLuint sceneDepth;
+
+// quarter resolution pre-pass that marks each 4x4 screen tile lit, shadowed or penumbra,
+// so PCSS, VSSM and MSM only run their soft filter where the tile is in a penumbra
+#define PENUMBRA_TILE 4
+// widest penumbra in shadow map texels, the BLOCK_RADIUS * lightWidth * SMDiffuse search of PCSS and VSSM
+#define PENUMBRA_MAX_TEXELS 30.0f
+#define PENUMBRA_MAX_DILATION 32 // tiles, the dilation is separable so this is 2 * 65 fetches per tile
+#define MASK_CASCADES 0
+#define MASK_VARIANCE 1
+#define MASK_MSM 2
+bool penumbraMaskEnabled = true;
+GLuint penumbraHardFBO = 0;
+GLuint penumbraHardShadow;
+GLuint penumbraHardDepth;
+GLuint penumbraRangeFBO = 0;
+GLuint penumbraRange; // the dilation along rows
+GLuint penumbraMaskFBO = 0;
+GLuint penumbraMask;
+int penumbraDilation = 1;
+
+// deferred shadows: after a depth pre-pass, a full-screen pass evaluates the directional shadow
+// once per pixel, optionally at half resolution with a depth-aware upsample, and the lit pass reads it
+bool screenShadowMaskEnabled = false;
+// temporal accumulation of the screen-space mask: PCF and PCSS take 8 taps rotated differently
+// every frame, reprojected history is kept where depth and normal still match
+bool temporalShadowsEnabled = false;
+bool temporalHistoryValid = false;
+GLuint temporalFBO[2];
+GLuint temporalTexture[2]; // r occlusion, g linear depth, b frames accumulated, a packed normal
+int temporalHistory = 0; // which of the two holds last frame's result
+int temporalFrame = 0;
+glm::mat4 temporalPrevViewProj;
+glm::vec3 temporalPrevLightPos; // the light's view, its projection follows the camera and is left to the rejection
+int temporalPrevMode = 0;
+// forward lit pass behind a depth pre-pass, so the shadow filters run once per visible pixel
+bool depthPrePassEnabled = false;
+bool screenShadowMaskHalfRes = false;
+GLuint screenMaskFBO[2]; // full and half resolution, occlusion in r and linear view depth in g
+GLuint screenMaskTexture[2];
+std::map<GLuint, GLuint> screenMaskPrograms; // lit program -> its SHADOW_MASK_PASS build
+
+// sample distribution shadow maps, splits and light bounds follow the visible depth range
+// that the GPU reduces from the camera depth buffer and reads back a frame late
+#define DEPTH_REDUCE_BLOCK 4
+bool sdsmEnabled = false;
+std::vector<GLuint> depthReduceFBO;
+std::vector<GLuint> depthReduceTexture;
+std::vector<glm::ivec2> depthReduceSize;
+GLuint depthReducePBO[2];
+bool depthReducePending[2] = { false, false };
+int depthReduceFrame = 0;
+GLfloat visibleDepthMin = 0.0f;
+GLfloat visibleDepthMax = 0.0f;
+
+// hierarchical-z occlusion culling. The pre-pass depth is reduced to a farthest depth pyramid,
+// objects are tested on the CPU against last frame's pyramid, read back a frame late, and the
+// ones it rejects are retested on the GPU against this frame's, their draws waiting on that
+#define HIZ_READBACK_LEVEL 3 // 100x75 at 1600x1200
+#define HIZ_UNIT 11
+bool hiZEnabled = false;
+GLuint hiZTexture; // level 0 at half resolution
+std::vector<GLuint> hiZFBO; // one per level
+std::vector<glm::ivec2> hiZSize;
+int hiZReadbackLevel = 0;
+GLuint hiZPBO[2];
+bool hiZPending[2] = { false, false };
+glm::mat4 hiZPendingViewProj[2];
+int hiZFrame = 0;
+std::vector<std::vector<float> > hiZLevels; // CPU copy, the read back level and the ones above it
+std::vector<glm::ivec2> hiZLevelSize;
+glm::mat4 hiZViewProj; // camera the CPU copy was rendered with
+bool hiZValid = false;
+std::vector<char> objectHiZRetest; // failed the CPU test, drawn only if the GPU retest passes
+std::vector<GLuint> hiZQueries;
+
+// occlusion queries for heavy meshes, their bounding box is drawn against the pre-pass depth and
+// the full draw made conditional on it without waiting. Objects found visible are requeried every
+// few frames, hidden ones every frame, and results are only read once the GPU has them
+#define OCCLUSION_QUERY_MIN_VERTICES 10000 // the bunny, not the teapots
+#define OCCLUSION_QUERY_INTERVAL 4
+#define OCCLUSION_HIDE_RESULTS 2 // hidden results in a row before an object counts as hidden
+struct OcclusionQueryState
+{
+	GLuint queries[2]; // alternating frames, read back like the other queries a frame or two late
+	bool pending[2];
+	bool visible;
+	int hiddenResults;
+};
+bool occlusionQueriesEnabled = false;
+std::vector<OcclusionQueryState> occlusionQueryStates;
+std::vector<char> objectQueried; // box queried this frame, the full draws are conditional on it
+ModelData occlusionBox; // unit cube
+int occlusionFrame = 0;
+int occlusionQueriesIssued = 0;
+int occlusionHidden = 0;
+
+#pragma region MESH LOADING
+/*----------------------------------------------------------------------------
+MESH LOADING FUNCTION
+----------------------------------------------------------------------------*/
+
+ModelData load_mesh(const char* file_name) {
+	ModelData modelData;
+
+	const aiScene* scene = aiImportFile(
+		file_name,
+		aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_PreTransformVertices | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace
+	);
+
+	if (!scene) {
+		fprintf(stderr, "ERROR: reading mesh %s\n", file_name);
+		return modelData;
+	}
+
+	printf("  %i materials\n", scene->mNumMaterials);
+	printf("  %i meshes\n", scene->mNumMeshes);
+	printf("  %i textures\n", scene->mNumTextures);
+
+	modelData.mBoundsMin = glm::vec3(FLT_MAX);
+	modelData.mBoundsMax = glm::vec3(-FLT_MAX);
+
+	for (unsigned int m_i = 0; m_i < scene->mNumMeshes; m_i++) {
+		const aiMesh* mesh = scene->mMeshes[m_i];
+		printf("    %i vertices in mesh\n", mesh->mNumVertices);
+		modelData.mPointCount += mesh->mNumVertices;
+		for (unsigned int v_i = 0; v_i < mesh->mNumVertices; v_i++) {
+			if (mesh->HasPositions()) {
+				const aiVector3D* vp = &(mesh->mVertices[v_i]);
+				modelData.mVertices.push_back(vec3(vp->x, vp->y, vp->z));
+				modelData.mBoundsMin = glm::min(modelData.mBoundsMin, glm::vec3(vp->x, vp->y, vp->z));
+				modelData.mBoundsMax = glm::max(modelData.mBoundsMax, glm::vec3(vp->x, vp->y, vp->z));
+			}
+			if (mesh->HasNormals()) {
+				const aiVector3D* vn = &(mesh->mNormals[v_i]);
+				modelData.mNormals.push_back(vec3(vn->x, vn->y, vn->z));
+			}
+			if (mesh->HasTextureCoords(0)) {
+				const aiVector3D* vt = &(mesh->mTextureCoords[0][v_i]);
+				modelData.mTextureCoords.push_back(vec2(vt->x, vt->y));
+			}
+			if (mesh->HasTangentsAndBitangents()) {
+				const aiVector3D* vta = &(mesh->mTangents[v_i]);
+				modelData.mTangents.push_back(vec3(vta->x, vta->y, vta->z));
+				const aiVector3D* vbt = &(mesh->mBitangents[v_i]);
+				modelData.mBitangents.push_back(vec3(vbt->x, vbt->y, vbt->z));
+			}
+		}
+	}
+	aiReleaseImport(scene);
+	return modelData;
+}
+
+#pragma endregion MESH LOADING
+
+// Shader Functions- click on + to expand
+#pragma region SHADER_FUNCTIONS
+// includeStack holds the files being spliced in, to catch recursive includes
+char* readShaderSource(const char* shaderFile, std::vector<std::string>* includeStack = NULL) {
+	std::vector<std::string> stack;
+	if (includeStack == NULL) {
+		includeStack = &stack;
+	}
+	if (std::find(includeStack->begin(), includeStack->end(), std::string(shaderFile)) != includeStack->end()) {
+		std::cerr << "Error: shader " << shaderFile << " includes itself" << std::endl;
+		return NULL;
+	}
+
+	FILE* fp;
+	fopen_s(&fp, shaderFile, "rb");
+
+	if (fp == NULL) { return NULL; }
+
+	fseek(fp, 0L, SEEK_END);
+	long size = ftell(fp);
+
+	fseek(fp, 0L, SEEK_SET);
+	char* buf = new char[size + 1];
+	fread(buf, 1, size, fp);
+	buf[size] = '\0';
+
+	fclose(fp);
+
+	// splice in #include "file" lines, the path is relative to the including shader
+	std::string source(buf);
+	delete[] buf;
+	std::string dir(shaderFile);
+	dir = dir.substr(0, dir.find_last_of("/\\") + 1);
+	includeStack->push_back(shaderFile);
+	size_t pos = 0;
+	while ((pos = source.find("#include", pos)) != std::string::npos) {
+		// only a directive at the start of a line, not the word in a comment
+		size_t lineStart = pos == 0 ? 0 : source.rfind('\n', pos - 1);
+		lineStart = lineStart == std::string::npos || pos == 0 ? 0 : lineStart + 1;
+		if (source.find_first_not_of(" \t", lineStart) != pos) {
+			pos += strlen("#include");
+			continue;
+		}
+		size_t lineEnd = source.find('\n', pos);
+		size_t open = source.find('"', pos);
+		size_t close = open == std::string::npos ? std::string::npos : source.find('"', open + 1);
+		if (open == std::string::npos || close == std::string::npos || close > lineEnd) {
+			std::cerr << "Error: malformed #include in shader " << shaderFile << std::endl;
+			includeStack->pop_back();
+			return NULL;
+		}
+		std::string includeFile = dir + source.substr(open + 1, close - open - 1);
+		char* included = readShaderSource(includeFile.c_str(), includeStack);
+		if (included == NULL) {
+			std::cerr << "Error reading shader include " << includeFile << std::endl;
+			includeStack->pop_back();
+			return NULL;
+		}
+		// skip the UTF-8 BOM some editors add, it is not valid in the middle of a shader
+		const char* text = strncmp(included, "\xEF\xBB\xBF", 3) == 0 ? included + 3 : included;
+		source.replace(pos, close - pos + 1, text);
+		// nested includes are already spliced in
+		pos += strlen(text);
+		delete[] included;
+	}
+	includeStack->pop_back();
+
+	buf = new char[source.size() + 1];
+	memcpy(buf, source.c_str(), source.size() + 1);
+	return buf;
+}
+
+
+static void AddShader(GLuint ShaderProgram, const char* pShaderText, GLenum ShaderType, const char* defines = NULL)
+{
+	// create a shader object
+	GLuint ShaderObj = glCreateShader(ShaderType);
+
+	if (ShaderObj == 0) {
+		std::cerr << "Error creating shader..." << std::endl;
+		std::cerr << "Press enter/return to exit..." << std::endl;
+		std::cin.get();
+		exit(1);
+	}
+	const char* pShaderSource = readShaderSource(pShaderText);
+	if (pShaderSource == NULL) {
+		std::cerr << "Error reading shader " << pShaderText << std::endl;
+		std::cerr << "Press enter/return to exit..." << std::endl;
+		std::cin.get();
+		exit(1);
+	}
+
+	// compile time constants go right after the #version line
+	std::string source(pShaderSource);
+	if (defines != NULL) {
+		size_t versionEnd = source.find('\n', source.find("#version"));
+		source.insert(versionEnd + 1, defines);
+	}
+	const char* pSource = source.c_str();
+	// Bind the source code to the shader, this happens before compilation
+	glShaderSource(ShaderObj, 1, (const GLchar**)&pSource, NULL);
+	// compile the shader and check for errors
+	glCompileShader(ShaderObj);
+	GLint success;
+	// check for shader related errors using glGetShaderiv
+	glGetShaderiv(ShaderObj, GL_COMPILE_STATUS, &success);
+	if (!success) {
+		GLchar InfoLog[1024] = { '\0' };
+		glGetShaderInfoLog(ShaderObj, 1024, NULL, InfoLog);
+		std::cerr << "Error compiling "
+			<< (ShaderType == GL_VERTEX_SHADER ? "vertex" : ShaderType == GL_GEOMETRY_SHADER ? "geometry" : ShaderType == GL_COMPUTE_SHADER ? "compute" : "fragment")
+			<< " shader program: " << InfoLog << std::endl;
+		std::cerr << "Press enter/return to exit..." << std::endl;
+		std::cin.get();
+		exit(1);
+	}
+	// Attach the compiled shader object to the program object
+	glAttachShader(ShaderProgram, ShaderObj);
+}
+
+GLuint CompileShaders(const char* vshadername, const char* fshadername, const char* gshadername = NULL, const char* defines = NULL)
+{
+	//Start the process of setting up our shaders by creating a program ID
+	//Note: we will link all the shaders together into this ID
+	GLuint shaderProgramID = glCreateProgram();
+	if (shaderProgramID == 0) {
+		std::cerr << "Error creating shader program..." << std::endl;
+		std::cerr << "Press enter/return to exit..." << std::endl;
+		std::cin.get();
+		exit(1);
+	}
+
+	// Create two shader objects, one for the vertex, and one for the fragment shader
+	AddShader(shaderProgramID, vshadername, GL_VERTEX_SHADER, defines);
+	AddShader(shaderProgramID, fshadername, GL_FRAGMENT_SHADER, defines);
+	if (gshadername != NULL) {
+		AddShader(shaderProgramID, gshadername, GL_GEOMETRY_SHADER, defines);
+	}
+
+	GLint Success = 0;
+	GLchar ErrorLog[1024] = { '\0' };
+	// After compiling all shader objects and attaching them to the program, we can finally link it
+	glLinkProgram(shaderProgramID);
+	// check for program related errors using glGetProgramiv
+	glGetProgramiv(shaderProgramID, GL_LINK_STATUS, &Success);
+	if (Success == 0) {
+		glGetProgramInfoLog(shaderProgramID, sizeof(ErrorLog), NULL, ErrorLog);
+		std::cerr << "Error linking shader program: " << ErrorLog << std::endl;
+		std::cerr << "Press enter/return to exit..." << std::endl;
+		std::cin.get();
+		exit(1);
+	}
+
+	// program has been successfully linked but needs to be validated to check whether the program can execute given the current pipeline state
+	glValidateProgram(shaderProgramID);
+	// check for program related errors using glGetProgramiv
+	glGetProgramiv(shaderProgramID, GL_VALIDATE_STATUS, &Success);
+	if (!Success) {
+		glGetProgramInfoLog(shaderProgramID, sizeof(ErrorLog), NULL, ErrorLog);
+		std::cerr << "Invalid shader program: " << ErrorLog << std::endl;
+		std::cerr << "Press enter/return to exit..." << std::endl;
+		std::cin.get();
+		exit(1);
+	}
+	// Finally, use the linked shader program
+	// Note: this program will stay in effect for all draw calls until you replace it with another or explicitly disable its use
+	glUseProgram(shaderProgramID);
+	return shaderProgramID;
+}
+// Lit programs are also built as the full-screen mask pass of the same fragment shader
+GLuint CompileLitProgram(const char* fshadername, const char* defines = NULL)
+{
+	std::string litDefines = std::string(pointShadowsSupported ? "#define POINT_SHADOWS\n" : "") + (defines != NULL ? defines : "");
+	GLuint ID = CompileShaders("./shaders/shadowVertexShader.txt", fshadername, NULL, litDefines.c_str());
+	std::string maskDefines = "#define SHADOW_MASK_PASS\n" + litDefines;
+	screenMaskPrograms[ID] = CompileShaders("./shaders/shadowDD2VertexShader.txt", fshadername, NULL, maskDefines.c_str());
+	return ID;
+}
+GLuint CompileComputeShader(const char* cshadername)
+{
+	GLuint shaderProgramID = glCreateProgram();
+	AddShader(shaderProgramID, cshadername, GL_COMPUTE_SHADER);
+	GLint Success = 0;
+	GLchar ErrorLog[1024] = { '\0' };
+	glLinkProgram(shaderProgramID);
+	glGetProgramiv(shaderProgramID, GL_LINK_STATUS, &Success);
+	if (Success == 0) {
+		glGetProgramInfoLog(shaderProgramID, sizeof(ErrorLog), NULL, ErrorLog);
+		std::cerr << "Error linking shader program: " << ErrorLog << std::endl;
+		std::cerr << "Press enter/return to exit..." << std::endl;
+		std::cin.get();
+		exit(1);
+	}
+	return shaderProgramID;
+}
+#pragma endregion SHADER_FUNCTIONS
+
+unsigned int loadTexture(const char* texture) {
+	unsigned int vto = 0;
+	glGenTextures(1, &vto);
+	int width, height, nrComponents;
+	unsigned char* data = stbi_load(texture, &width, &height, &nrComponents, 0);
+	GLenum format = GL_RGB;
+	if (nrComponents == 1)
+		format = GL_RED;
+	else if (nrComponents == 3)
+		format = GL_RGB;
+	else if (nrComponents == 4)
+		format = GL_RGBA;
+	glBindTexture(GL_TEXTURE_2D, vto);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	stbi_image_free(data);
+	return vto;
+}
+
+// VBO Functions - click on + to expand
+#pragma region VBO_FUNCTIONS
+void generateObjectBufferMesh(GLuint& ID, ModelData& mesh_data) {
+	loc1 = glGetAttribLocation(ID, "vertex_position");
+	loc2 = glGetAttribLocation(ID, "vertex_normal");
+	loc3 = glGetAttribLocation(ID, "vertex_texture");
+	loc4 = glGetAttribLocation(ID, "aTangent");
+	loc5 = glGetAttribLocation(ID, "aBitangent");
+
+	// upload once, every shadow cascade and the lit pass draw from the same buffers
+	if (mesh_data.mVBO[0] == 0) {
+		glGenBuffers(5, mesh_data.mVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh_data.mVBO[0]);
+		glBufferData(GL_ARRAY_BUFFER, mesh_data.mPointCount * sizeof(vec3), &mesh_data.mVertices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh_data.mVBO[1]);
+		glBufferData(GL_ARRAY_BUFFER, mesh_data.mPointCount * sizeof(vec3), &mesh_data.mNormals[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh_data.mVBO[2]);
+		glBufferData(GL_ARRAY_BUFFER, mesh_data.mPointCount * sizeof(vec2), &mesh_data.mTextureCoords[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh_data.mVBO[3]);
+		glBufferData(GL_ARRAY_BUFFER, mesh_data.mPointCount * sizeof(vec3), &mesh_data.mTangents[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh_data.mVBO[4]);
+		glBufferData(GL_ARRAY_BUFFER, mesh_data.mPointCount * sizeof(vec3), &mesh_data.mBitangents[0], GL_STATIC_DRAW);
+	}
+	unsigned int vp_vbo = mesh_data.mVBO[0];
+	unsigned int vn_vbo = mesh_data.mVBO[1];
+	unsigned int vt_vbo = mesh_data.mVBO[2];
+	unsigned int va_vbo = mesh_data.mVBO[3];
+	unsigned int vb_vbo = mesh_data.mVBO[4];
+
+	unsigned int vao = 0;
+	glBindVertexArray(vao);
+
+	glEnableVertexAttribArray(loc1);
+	glBindBuffer(GL_ARRAY_BUFFER, vp_vbo);
+	glVertexAttribPointer(loc1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	glEnableVertexAttribArray(loc2);
+	glBindBuffer(GL_ARRAY_BUFFER, vn_vbo);
+	glVertexAttribPointer(loc2, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	glEnableVertexAttribArray(loc3);
+	glBindBuffer(GL_ARRAY_BUFFER, vt_vbo);
+	glVertexAttribPointer(loc3, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+	glEnableVertexAttribArray(loc4);
+	glBindBuffer(GL_ARRAY_BUFFER, va_vbo);
+	glVertexAttribPointer(loc4, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	glEnableVertexAttribArray(loc5);
+	glBindBuffer(GL_ARRAY_BUFFER, vb_vbo);
+	glVertexAttribPointer(loc5, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+}
+
+void generateDepthMap() {
+	glGenFramebuffers(1, &depthMapFBO);
+	glGenTextures(1, &depthMap);
+	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthMap);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, MAX_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	// outside a cascade counts as lit instead of repeating the map
+	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMap, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GLuint varianceFBO[2];
+GLuint varianceTexture[2];
+GLuint depthMapFBO2 = 0;
+GLuint depthMap2;
+GLuint depthMapRBO2;
+void generateVarianceMap() {
+	glGenFramebuffers(1, &depthMapFBO2);
+	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO2);
+	glGenRenderbuffers(1, &depthMapRBO2);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthMapRBO2);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 1024, 1024);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthMapRBO2);
+	glGenTextures(1, &depthMap2);
+	glBindTexture(GL_TEXTURE_2D, depthMap2);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, 1024, 1024, 0, GL_RG, GL_FLOAT,NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, depthMap2, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenFramebuffers(2, varianceFBO);
+	glGenTextures(2, varianceTexture);
+	for (int i = 0; i < 2; i++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, varianceFBO[i]);
+		glBindTexture(GL_TEXTURE_2D, varianceTexture[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, 1024, 1024, 0, GL_RG, GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, varianceTexture[i], 0);
+	}
+}
+
+// static caster layers for the shadow cache, same formats as the maps they are copied into
+void generateShadowCache() {
+	glGenFramebuffers(1, &staticDepthMapFBO);
+	glGenTextures(1, &staticDepthMap);
+	glBindFramebuffer(GL_FRAMEBUFFER, staticDepthMapFBO);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, staticDepthMap);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, MAX_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticDepthMap, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	glGenFramebuffers(1, &staticMomentFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, staticMomentFBO);
+	glGenRenderbuffers(1, &staticMomentRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, staticMomentRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 1024, 1024);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, staticMomentRBO);
+	glGenTextures(1, &staticMomentMap);
+	glBindTexture(GL_TEXTURE_2D, staticMomentMap);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, 1024, 1024, 0, GL_RG, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, staticMomentMap, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void generateShadowAtlas() {
+	glGenFramebuffers(1, &shadowAtlasFBO);
+	glGenTextures(1, &shadowAtlas);
+	glBindFramebuffer(GL_FRAMEBUFFER, shadowAtlasFBO);
+	glBindTexture(GL_TEXTURE_2D, shadowAtlas);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowAtlas, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(1, &atlasLightsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, atlasLightsUBO);
+	glBufferData(GL_UNIFORM_BUFFER, 16 + MAX_ATLAS_LIGHTS * sizeof(AtlasLightBlock), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, ATLAS_LIGHTS_BINDING, atlasLightsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void generatePointShadowMaps() {
+	glGenFramebuffers(1, &pointShadowFBO);
+	glGenTextures(1, &pointShadowMaps);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, pointShadowMaps);
+	glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_DEPTH_COMPONENT32F, POINT_SHADOW_SIZE, POINT_SHADOW_SIZE, 6 * MAX_POINT_LIGHTS, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	// layered attachment, the geometry shader picks the face with gl_Layer
+	glBindFramebuffer(GL_FRAMEBUFFER, pointShadowFBO);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, pointShadowMaps, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+}
+
+// a color target plus its own depth buffer, sized like the VSSM moments
+void generateMomentTarget(GLuint& fbo, GLuint& texture, GLuint* rbo, GLenum format) {
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	if (rbo != NULL) {
+		glGenRenderbuffers(1, rbo);
+		glBindRenderbuffer(GL_RENDERBUFFER, *rbo);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 1024, 1024);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, *rbo);
+	}
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, 1024, 1024, 0, GL_RGBA, GL_UNSIGNED_SHORT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void generateMomentShadowMap() {
+	generateMomentTarget(msmFBO, msmMap, &msmRBO, GL_RGBA16);
+	generateMomentTarget(msmStaticFBO, msmStaticMap, &msmStaticRBO, GL_RGBA16);
+	for (int i = 0; i < 2; i++) {
+		generateMomentTarget(msmBlurFBO[i], msmBlurTexture[i], NULL, GL_RGBA16);
+	}
+}
+
+// (Re)allocate the exponential targets at 16 or 32 bit float
+void allocateExponentialMaps() {
+	GLenum format = expPrecision32 ? GL_RGBA32F : GL_RGBA16F;
+	GLuint textures[] = { expMap, expStaticMap, expBlurTexture[0], expBlurTexture[1] };
+	for (GLuint texture : textures) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, 1024, 1024, 0, GL_RGBA, GL_FLOAT, NULL);
+	}
+	glGenerateMipmap(GL_TEXTURE_2D);
+	expMapCache.valid = false;
+}
+
+void generateExponentialShadowMap() {
+	generateMomentTarget(expFBO, expMap, &expRBO, GL_RGBA32F);
+	generateMomentTarget(expStaticFBO, expStaticMap, &expStaticRBO, GL_RGBA32F);
+	for (int i = 0; i < 2; i++) {
+		generateMomentTarget(expBlurFBO[i], expBlurTexture[i], NULL, GL_RGBA32F);
+	}
+	glBindTexture(GL_TEXTURE_2D, expBlurTexture[1]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	if (GLEW_EXT_texture_filter_anisotropic) {
+		GLfloat maxAnisotropy = 1.0f;
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, glm::min(maxAnisotropy, 16.0f));
+	}
+	allocateExponentialMaps();
+}
+
+// exponents of the current storage precision
+glm::vec3 getExponents() {
+	return expExponents[expPrecision32];
+}
+
+// largest exponents the current storage holds without overflow
+glm::vec3 getMaxExponents() {
+	if (expPrecision32) {
+		return glm::vec3(ESM_MAX_EXPONENT_32, EVSM_MAX_EXPONENT_32, EVSM_MAX_EXPONENT_32);
+	}
+	return glm::vec3(ESM_MAX_EXPONENT_16, EVSM_MAX_EXPONENT_16, EVSM_MAX_EXPONENT_16);
+}
+
+// Blue noise by void filling: each rank goes to the pixel with the least gaussian energy from the ones before
+void generateBlueNoise() {
+	const int n = BLUE_NOISE_SIZE;
+	std::vector<float> kernel(n * n);
+	for (int y = 0; y < n; y++) {
+		for (int x = 0; x < n; x++) {
+			// toroidal distance, the texture repeats over the screen
+			float dx = (float)glm::min(x, n - x);
+			float dy = (float)glm::min(y, n - y);
+			kernel[y * n + x] = exp(-(dx * dx + dy * dy) / (2.0f * 1.9f * 1.9f));
+		}
+	}
+	std::vector<float> energy(n * n, 0.0f);
+	std::vector<float> noise(n * n, -1.0f);
+	for (int rank = 0; rank < n * n; rank++) {
+		int best = -1;
+		for (int i = 0; i < n * n; i++) {
+			if (noise[i] < 0.0f && (best < 0 || energy[i] < energy[best])) {
+				best = i;
+			}
+		}
+		noise[best] = (rank + 0.5f) / (n * n);
+		int bx = best % n;
+		int by = best / n;
+		for (int y = 0; y < n; y++) {
+			for (int x = 0; x < n; x++) {
+				energy[y * n + x] += kernel[((y - by) & (n - 1)) * n + ((x - bx) & (n - 1))];
+			}
+		}
+	}
+	glGenTextures(1, &blueNoiseTexture);
+	glBindTexture(GL_TEXTURE_2D, blueNoiseTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, n, n, 0, GL_RED, GL_FLOAT, &noise[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+void generateMomentSAT() {
+	glGenFramebuffers(2, satFBO);
+	glGenTextures(2, satTexture);
+	for (int i = 0; i < 2; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, satFBO[i]);
+		glBindTexture(GL_TEXTURE_2D, satTexture[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, 1024, 1024, 0, GL_RG, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		// sums before the first texel are zero
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		GLfloat borderColor[] = { 0.0, 0.0, 0.0, 0.0 };
+		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, satTexture[i], 0);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void generateMinMaxPyramid() {
+	glGenFramebuffers(1, &minMaxFBO);
+	glGenTextures(1, &shadowMinMaxMap);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMinMaxMap);
+	for (int level = 0; level < MIN_MAX_LEVELS; level++) {
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RG32F, MIN_MAX_SIZE >> level, MIN_MAX_SIZE >> level, MAX_CASCADES, 0, GL_RG, GL_FLOAT, NULL);
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, MIN_MAX_LEVELS - 1);
+}
+
+void generateShadowSampler() {
+	glGenSamplers(1, &shadowCompareSampler);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	GLfloat borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
+	glSamplerParameterfv(shadowCompareSampler, GL_TEXTURE_BORDER_COLOR, borderColor);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	glGenQueries(GPU_TIMER_FRAMES * GPU_TIMESTAMPS, &gpuTimerQueries[0][0]);
+
+	pcfCountersSupported = GLEW_VERSION_4_2 || GLEW_ARB_shader_atomic_counters;
+	if (pcfCountersSupported) {
+		glGenBuffers(1, &pcfCounterBuffer);
+		glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, pcfCounterBuffer);
+		glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(pcfCounts), NULL, GL_DYNAMIC_READ);
+		glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+	}
+}
+
+void generateSceneFBO() {
+	glGenFramebuffers(1, &sceneFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+	glGenTextures(1, &sceneColor);
+	glBindTexture(GL_TEXTURE_2D, sceneColor);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColor, 0);
+	glGenTextures(1, &sceneDepth);
+	glBindTexture(GL_TEXTURE_2D, sceneDepth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sceneDepth, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void generatePenumbraMask() {
+	int maskWidth = width / PENUMBRA_TILE;
+	int maskHeight = height / PENUMBRA_TILE;
+	glGenFramebuffers(1, &penumbraHardFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, penumbraHardFBO);
+	glGenTextures(1, &penumbraHardShadow);
+	glBindTexture(GL_TEXTURE_2D, penumbraHardShadow);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, maskWidth, maskHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, penumbraHardShadow, 0);
+	glGenRenderbuffers(1, &penumbraHardDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, penumbraHardDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, maskWidth, maskHeight);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, penumbraHardDepth);
+
+	glGenFramebuffers(1, &penumbraRangeFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, penumbraRangeFBO);
+	glGenTextures(1, &penumbraRange);
+	glBindTexture(GL_TEXTURE_2D, penumbraRange);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, maskWidth, maskHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, penumbraRange, 0);
+
+	glGenFramebuffers(1, &penumbraMaskFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, penumbraMaskFBO);
+	glGenTextures(1, &penumbraMask);
+	glBindTexture(GL_TEXTURE_2D, penumbraMask);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, maskWidth, maskHeight, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, penumbraMask, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void generateScreenShadowMask() {
+	glGenFramebuffers(2, screenMaskFBO);
+	glGenTextures(2, screenMaskTexture);
+	for (int i = 0; i < 2; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, screenMaskFBO[i]);
+		glBindTexture(GL_TEXTURE_2D, screenMaskTexture[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width >> i, height >> i, 0, GL_RG, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screenMaskTexture[i], 0);
+	}
+	glGenFramebuffers(2, temporalFBO);
+	glGenTextures(2, temporalTexture);
+	for (int i = 0; i < 2; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, temporalFBO[i]);
+		glBindTexture(GL_TEXTURE_2D, temporalTexture[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, temporalTexture[i], 0);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// min/max chain from the camera depth buffer down to a single texel
+void generateDepthReduction() {
+	glm::ivec2 size = glm::ivec2(width, height);
+	while (size.x > 1 || size.y > 1) {
+		size = glm::ivec2((size.x + DEPTH_REDUCE_BLOCK - 1) / DEPTH_REDUCE_BLOCK, (size.y + DEPTH_REDUCE_BLOCK - 1) / DEPTH_REDUCE_BLOCK);
+		GLuint fbo, texture;
+		glGenFramebuffers(1, &fbo);
+		glGenTextures(1, &texture);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, size.x, size.y, 0, GL_RG, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+		depthReduceFBO.push_back(fbo);
+		depthReduceTexture.push_back(texture);
+		depthReduceSize.push_back(size);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(2, depthReducePBO);
+	for (int i = 0; i < 2; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, depthReducePBO[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, 2 * sizeof(float), NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// farthest depth pyramid of the camera depth buffer, halving down to a single texel
+void generateHiZ() {
+	glGenTextures(1, &hiZTexture);
+	glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+	glBindTexture(GL_TEXTURE_2D, hiZTexture);
+	glm::ivec2 size = glm::ivec2(width, height);
+	do {
+		size = glm::ivec2(glm::max(size.x / 2, 1), glm::max(size.y / 2, 1));
+		glTexImage2D(GL_TEXTURE_2D, (GLint)hiZSize.size(), GL_R32F, size.x, size.y, 0, GL_RED, GL_FLOAT, NULL);
+		hiZSize.push_back(size);
+	} while (size.x > 1 || size.y > 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)hiZSize.size() - 1);
+	for (size_t i = 0; i < hiZSize.size(); i++) {
+		GLuint fbo;
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hiZTexture, (GLint)i);
+		hiZFBO.push_back(fbo);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	hiZReadbackLevel = glm::min(HIZ_READBACK_LEVEL, (int)hiZSize.size() - 1);
+	glm::ivec2 readbackSize = hiZSize[hiZReadbackLevel];
+	glGenBuffers(2, hiZPBO);
+	for (int i = 0; i < 2; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, hiZPBO[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, readbackSize.x * readbackSize.y * sizeof(float), NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// proxy drawn for the occlusion queries, scaled to each object's bounds
+void generateOcclusionBox() {
+	const int faces[6][4] = { { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 6, 7, 5 } };
+	const int triangle[6] = { 0, 1, 2, 0, 2, 3 };
+	for (int f = 0; f < 6; f++) {
+		for (int v = 0; v < 6; v++) {
+			int corner = faces[f][triangle[v]];
+			occlusionBox.mVertices.push_back(vec3((float)(corner & 1), (float)((corner >> 1) & 1), (float)((corner >> 2) & 1)));
+			occlusionBox.mNormals.push_back(vec3(0.0f, 0.0f, 0.0f));
+			occlusionBox.mTextureCoords.push_back(vec2(0.0f, 0.0f));
+			occlusionBox.mTangents.push_back(vec3(0.0f, 0.0f, 0.0f));
+			occlusionBox.mBitangents.push_back(vec3(0.0f, 0.0f, 0.0f));
+		}
+	}
+	occlusionBox.mPointCount = occlusionBox.mVertices.size();
+	occlusionBox.mBoundsMin = glm::vec3(0.0f);
+	occlusionBox.mBoundsMax = glm::vec3(1.0f);
+}
+
+#pragma endregion VBO_FUNCTIONS
+
+void drawText(const char* str, GLfloat size, glm::vec3 pos) {
+	// Initialize glText
+	gltInit();
+	// Creating text
+	GLTtext* text = gltCreateText();
+	gltSetText(text, str);
+	// Begin text drawing (this for instance calls glUseProgram)
+	gltBeginDraw();
+	// Draw any amount of text between begin and end
+	gltColor(1.0f, 1.0f, 1.0f, 1.0f);
+	gltDrawText2DAligned(text, 70 * (pos.x + 1), 450 - pos.y * 70, size, GLT_CENTER, GLT_CENTER);
+	// Finish drawing text
+	gltEndDraw();
+	// Deleting text
+	gltDeleteText(text);
+	// Destroy glText
+	gltTerminate();
+}
+
+unsigned int quadVAO = 0;
+unsigned int quadVBO;
+void renderQuad()
+{
+	if (quadVAO == 0)
+	{
+		float quadVertices[] = {
+			// position        // uv
+			-1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
+			-1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+			1.0f, 1.0f, 0.0f, 1.0f, 1.0f,
+			1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
+		};
+		glGenVertexArrays(1, &quadVAO);
+		glGenBuffers(1, &quadVBO);
+		glBindVertexArray(quadVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+	}
+	glBindVertexArray(quadVAO);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glBindVertexArray(0);
+}
+
+glm::mat4 getModelMatrix(glm::vec3 pos, GLuint type, float scale) {
+	glm::mat4 model = glm::mat4(1.0f);
+	model = glm::translate(model, pos);
+	model = glm::scale(model, glm::vec3(scale, scale, scale));
+	if (type == 1) {
+		model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+		model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+	else if (type == 2) {
+		model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+	return model;
+}
+
+void displayNormalObject(GLuint& ID, glm::vec3 pos, ModelData& mesh_data, GLuint type, float scale) {
+	generateObjectBufferMesh(ID, mesh_data);
+	glm::mat4 model = getModelMatrix(pos, type, scale);
+
+	glUniformMatrix4fv(glGetUniformLocation(ID, "model"), 1, GL_FALSE, &model[0][0]);
+	glDrawArrays(GL_TRIANGLES, 0, mesh_data.mPointCount);
+}
+
+void resetCullCounters() {
+	for (int i = 0; i < CULL_PASS_COUNT; i++) {
+		cullCounters[i].drawn = 0;
+		cullCounters[i].culled = 0;
+		cullCounters[i].retested = 0;
+	}
+}
+
+CullCounters getCullCounters(int pass) {
+	return cullCounters[pass];
+}
+
+// pass is one of CULL_PASS_*, skipping what cullCameraFrustum found outside the view. Objects
+// that failed the hierarchical-z test or have a box query this frame are left out of the
+// pre-pass, which draws them after their query, and are conditional on it in the lit pass
+void displayScene(GLuint& ID, int pass) {
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		if (i < objectInFrustum.size() && !objectInFrustum[i]) {
+			cullCounters[pass].culled++;
+			continue;
+		}
+		bool retest = pass != CULL_PASS_PENUMBRA && i < objectHiZRetest.size() && objectHiZRetest[i];
+		bool queried = pass != CULL_PASS_PENUMBRA && i < objectQueried.size() && objectQueried[i];
+		if ((retest || queried) && pass == CULL_PASS_PREPASS) {
+			continue;
+		}
+		if (retest) {
+			glBeginConditionalRender(hiZQueries[i], GL_QUERY_WAIT);
+			cullCounters[pass].retested++;
+		}
+		else if (queried) {
+			glBeginConditionalRender(occlusionQueryStates[i].queries[occlusionFrame % 2], GL_QUERY_NO_WAIT);
+			cullCounters[pass].retested++;
+		}
+		else {
+			cullCounters[pass].drawn++;
+		}
+		displayNormalObject(ID, sceneObjects[i].pos, *sceneObjects[i].mesh, sceneObjects[i].type, sceneObjects[i].scale);
+		if (retest || queried) {
+			glEndConditionalRender();
+		}
+	}
+}
+
+// moves the dynamic objects on a small circle around where they were placed
+void animateScene() {
+	animation_angle += Delta;
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		if (sceneObjects[i].dynamic) {
+			sceneObjects[i].pos = sceneObjects[i].anchor + ANIMATION_RADIUS * glm::vec3(cos(glm::radians(animation_angle)), 0.0f, sin(glm::radians(animation_angle)));
+		}
+	}
+}
+
+// Compare the light projections and caster transforms with the ones the cached map was
+// rendered with, then remember the current ones since the caller re-renders what is dirty
+void checkShadowCache(ShadowCache& cache, const glm::mat4* matrices, int layers, bool& staticDirty, bool& dynamicDirty) {
+	staticDirty = !cache.valid || cache.layers != layers || cache.models.size() != sceneObjects.size();
+	dynamicDirty = false;
+	for (int i = 0; i < layers && !staticDirty; i++) {
+		staticDirty = cache.matrices[i] != matrices[i];
+	}
+	cache.lightChanged = staticDirty;
+	cache.models.resize(sceneObjects.size());
+	cache.previousModels = cache.models;
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		glm::mat4 model = getModelMatrix(sceneObjects[i].pos, sceneObjects[i].type, sceneObjects[i].scale);
+		if (cache.models[i] != model) {
+			if (sceneObjects[i].dynamic) { dynamicDirty = true; }
+			else { staticDirty = true; }
+			cache.models[i] = model;
+		}
+	}
+	for (int i = 0; i < layers; i++) {
+		cache.matrices[i] = matrices[i];
+	}
+	cache.layers = layers;
+	cache.valid = true;
+}
+
+#pragma region BOUNDS
+void getBoxCorners(glm::vec3 boundsMin, glm::vec3 boundsMax, glm::vec3 corners[8]) {
+	for (int i = 0; i < 8; i++) {
+		corners[i] = glm::vec3((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z);
+	}
+}
+
+// bounds of points after a transform, e.g. into light view space
+void getTransformedBounds(glm::mat4 transform, const glm::vec3* points, int count, glm::vec3& boundsMin, glm::vec3& boundsMax) {
+	boundsMin = glm::vec3(FLT_MAX);
+	boundsMax = glm::vec3(-FLT_MAX);
+	for (int i = 0; i < count; i++) {
+		glm::vec4 p = transform * glm::vec4(points[i], 1.0f);
+		boundsMin = glm::min(boundsMin, glm::vec3(p) / p.w);
+		boundsMax = glm::max(boundsMax, glm::vec3(p) / p.w);
+	}
+}
+
+void getWorldBounds(const SceneObject& object, glm::vec3& boundsMin, glm::vec3& boundsMax) {
+	glm::vec3 corners[8];
+	getBoxCorners(object.mesh->mBoundsMin, object.mesh->mBoundsMax, corners);
+	getTransformedBounds(getModelMatrix(object.pos, object.type, object.scale), corners, 8, boundsMin, boundsMax);
+}
+
+// texel rectangle (x0, y0, x1, y1) a mesh covers in a shadow map layer, empty when x0 >= x1
+glm::ivec4 getShadowMapRect(const ModelData& mesh, glm::mat4 model, glm::mat4 lightMatrix) {
+	glm::vec3 corners[8], ndcMin, ndcMax;
+	getBoxCorners(mesh.mBoundsMin, mesh.mBoundsMax, corners);
+	getTransformedBounds(lightMatrix * model, corners, 8, ndcMin, ndcMax);
+	// one texel of slack for rasterization at the edges
+	int x0 = (int)floor((ndcMin.x * 0.5f + 0.5f) * SHADOW_MAP_SIZE) - 1;
+	int y0 = (int)floor((ndcMin.y * 0.5f + 0.5f) * SHADOW_MAP_SIZE) - 1;
+	int x1 = (int)ceil((ndcMax.x * 0.5f + 0.5f) * SHADOW_MAP_SIZE) + 1;
+	int y1 = (int)ceil((ndcMax.y * 0.5f + 0.5f) * SHADOW_MAP_SIZE) + 1;
+	return glm::ivec4(glm::clamp(x0, 0, SHADOW_MAP_SIZE), glm::clamp(y0, 0, SHADOW_MAP_SIZE),
+		glm::clamp(x1, 0, SHADOW_MAP_SIZE), glm::clamp(y1, 0, SHADOW_MAP_SIZE));
+}
+
+bool rectsOverlap(glm::ivec4 a, glm::ivec4 b) {
+	return a.x < b.z && b.x < a.z && a.y < b.w && b.y < a.w;
+}
+
+// light view space bounds of every shadow caster
+// with swept, dynamic objects count with their whole animation path so the bounds stay put
+// while they move, which the shadow caches rely on
+void getCasterLightBounds(glm::mat4 lightView, glm::vec3& boundsMin, glm::vec3& boundsMax, bool swept = false) {
+	boundsMin = glm::vec3(FLT_MAX);
+	boundsMax = glm::vec3(-FLT_MAX);
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		glm::vec3 worldMin, worldMax, corners[8], lightMin, lightMax;
+		getWorldBounds(sceneObjects[i], worldMin, worldMax);
+		if (swept && sceneObjects[i].dynamic) {
+			glm::vec3 offset = sceneObjects[i].anchor - sceneObjects[i].pos;
+			glm::vec3 path = glm::vec3(ANIMATION_RADIUS, 0.0f, ANIMATION_RADIUS);
+			worldMin += offset - path;
+			worldMax += offset + path;
+		}
+		getBoxCorners(worldMin, worldMax, corners);
+		getTransformedBounds(lightView, corners, 8, lightMin, lightMax);
+		boundsMin = glm::min(boundsMin, lightMin);
+		boundsMax = glm::max(boundsMax, lightMax);
+	}
+}
+
+// world space corners of the camera frustum between two view distances, near plane first
+void getFrustumCorners(float sliceNear, float sliceFar, glm::vec3 corners[8]) {
+	glm::mat4 invViewProj = glm::inverse(persp_proj * view);
+	for (int i = 0; i < 4; i++) {
+		float x = (i & 1) ? 1.0f : -1.0f;
+		float y = (i & 2) ? 1.0f : -1.0f;
+		glm::vec4 n = invViewProj * glm::vec4(x, y, -1.0f, 1.0f);
+		glm::vec4 f = invViewProj * glm::vec4(x, y, 1.0f, 1.0f);
+		glm::vec3 nearCorner = glm::vec3(n) / n.w;
+		glm::vec3 ray = glm::vec3(f) / f.w - nearCorner;
+		// view depth is linear along each corner ray
+		corners[i] = nearCorner + ray * ((sliceNear - camera_near) / (camera_far - camera_near));
+		corners[i + 4] = nearCorner + ray * ((sliceFar - camera_near) / (camera_far - camera_near));
+	}
+}
+
+void updateObjectBounds() {
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		SceneObject& object = sceneObjects[i];
+		getWorldBounds(object, object.boundsMin, object.boundsMax);
+		object.boundingSphere = glm::vec4((object.boundsMin + object.boundsMax) * 0.5f, glm::length(object.boundsMax - object.boundsMin) * 0.5f);
+	}
+
+	// the objects only move, so the hierarchy is refitted unless objects were added or removed
+	std::vector<glm::vec3> boundsMin(sceneObjects.size()), boundsMax(sceneObjects.size());
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		boundsMin[i] = sceneObjects[i].boundsMin;
+		boundsMax[i] = sceneObjects[i].boundsMax;
+	}
+	if (sceneBVH.itemCount != (int)sceneObjects.size()) {
+		sceneBVH.build(boundsMin.data(), boundsMax.data(), (int)sceneObjects.size());
+	}
+	else if (animateObjects) {
+		sceneBVH.refit(boundsMin.data(), boundsMax.data());
+	}
+
+	size_t padded = (sceneObjects.size() + CULL_WIDTH - 1) / CULL_WIDTH * CULL_WIDTH;
+	cullCenterX.assign(padded, 0.0f);
+	cullCenterY.assign(padded, 0.0f);
+	cullCenterZ.assign(padded, 0.0f);
+	cullExtentX.assign(padded, 0.0f);
+	cullExtentY.assign(padded, 0.0f);
+	cullExtentZ.assign(padded, 0.0f);
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		glm::vec3 center = (sceneObjects[i].boundsMin + sceneObjects[i].boundsMax) * 0.5f;
+		glm::vec3 extent = (sceneObjects[i].boundsMax - sceneObjects[i].boundsMin) * 0.5f;
+		cullCenterX[i] = center.x;
+		cullCenterY[i] = center.y;
+		cullCenterZ[i] = center.z;
+		cullExtentX[i] = extent.x;
+		cullExtentY[i] = extent.y;
+		cullExtentZ[i] = extent.z;
+	}
+}
+
+// the six planes of a clip volume with inward normals, left, right, bottom, top, near, far
+void getFrustumPlanes(const glm::mat4& m, glm::vec4 planes[6]) {
+	glm::mat4 rows = glm::transpose(m);
+	for (int i = 0; i < 3; i++) {
+		planes[i * 2] = rows[3] + rows[i];
+		planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for (int i = 0; i < 6; i++) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+#ifdef __AVX__
+#define CULL_FLOATS __m256
+#define cullLoad _mm256_loadu_ps
+#define cullSet _mm256_set1_ps
+#define cullAdd _mm256_add_ps
+#define cullMul _mm256_mul_ps
+#define cullOr _mm256_or_ps
+#define cullLess(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define cullMask _mm256_movemask_ps
+#define cullZero _mm256_setzero_ps
+#else
+#define CULL_FLOATS __m128
+#define cullLoad _mm_loadu_ps
+#define cullSet _mm_set1_ps
+#define cullAdd _mm_add_ps
+#define cullMul _mm_mul_ps
+#define cullOr _mm_or_ps
+#define cullLess _mm_cmplt_ps
+#define cullMask _mm_movemask_ps
+#define cullZero _mm_setzero_ps
+#endif
+
+// Fills objectInFrustum from the bounds of updateObjectBounds. A box is outside a plane when
+// its center distance plus its extents projected on the normal is still negative
+void cullCameraFrustum(const glm::mat4& viewProj) {
+	objectInFrustum.assign(sceneObjects.size(), 1);
+	if (!frustumCullingEnabled) {
+		return;
+	}
+	glm::vec4 planes[6];
+	getFrustumPlanes(viewProj, planes);
+	if (sceneObjects.size() >= BVH_MIN_OBJECTS) {
+		std::vector<int> visible;
+		sceneBVH.queryFrustum(planes, visible);
+		objectInFrustum.assign(sceneObjects.size(), 0);
+		for (size_t i = 0; i < visible.size(); i++) {
+			objectInFrustum[visible[i]] = 1;
+		}
+		return;
+	}
+	for (size_t i = 0; i < sceneObjects.size(); i += CULL_WIDTH) {
+		CULL_FLOATS cx = cullLoad(&cullCenterX[i]);
+		CULL_FLOATS cy = cullLoad(&cullCenterY[i]);
+		CULL_FLOATS cz = cullLoad(&cullCenterZ[i]);
+		CULL_FLOATS ex = cullLoad(&cullExtentX[i]);
+		CULL_FLOATS ey = cullLoad(&cullExtentY[i]);
+		CULL_FLOATS ez = cullLoad(&cullExtentZ[i]);
+		CULL_FLOATS outside = cullZero();
+		for (int p = 0; p < 6; p++) {
+			CULL_FLOATS distance = cullAdd(cullAdd(cullMul(cx, cullSet(planes[p].x)), cullMul(cy, cullSet(planes[p].y))), cullAdd(cullMul(cz, cullSet(planes[p].z)), cullSet(planes[p].w)));
+			CULL_FLOATS reach = cullAdd(cullAdd(cullMul(ex, cullSet(fabsf(planes[p].x))), cullMul(ey, cullSet(fabsf(planes[p].y)))), cullMul(ez, cullSet(fabsf(planes[p].z))));
+			outside = cullOr(outside, cullLess(cullAdd(distance, reach), cullZero()));
+		}
+		int mask = cullMask(outside);
+		for (size_t j = 0; j < CULL_WIDTH && i + j < sceneObjects.size(); j++) {
+			objectInFrustum[i + j] = !(mask & (1 << j));
+		}
+	}
+}
+
+bool sphereOutsidePlanes(const glm::vec4 planes[6], glm::vec4 sphere) {
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(planes[i]), glm::vec3(sphere)) + planes[i].w < -sphere.w) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// a box is outside when its corner furthest along a plane's normal is behind that plane
+bool boxOutsidePlanes(const glm::vec4 planes[6], glm::vec3 boundsMin, glm::vec3 boundsMax) {
+	for (int i = 0; i < 6; i++) {
+		glm::vec3 n = glm::vec3(planes[i]);
+		glm::vec3 p = glm::vec3(n.x >= 0.0f ? boundsMax.x : boundsMin.x, n.y >= 0.0f ? boundsMax.y : boundsMin.y, n.z >= 0.0f ? boundsMax.z : boundsMin.z);
+		if (glm::dot(n, p) + planes[i].w < 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Culling volume of one shadow pass. viewSlice is the range of view distances whose receivers
+// read this map, (0, 0) skips the swept test; it assumes an orthographic light matrix
+CasterCullVolume getCasterCullVolume(const glm::mat4& lightMatrix, glm::vec2 viewSlice) {
+	CasterCullVolume volume;
+	volume.lightMatrix = lightMatrix;
+	getFrustumPlanes(lightMatrix, volume.planes);
+	volume.swept = viewSlice.y > viewSlice.x;
+	if (volume.swept) {
+		glm::vec3 corners[8];
+		getFrustumCorners(viewSlice.x, viewSlice.y, corners);
+		getTransformedBounds(lightMatrix, corners, 8, volume.sliceMin, volume.sliceMax);
+		float margin = 2.0f * CULL_MARGIN_TEXELS / SHADOW_MAP_SIZE;
+		volume.sliceMin -= glm::vec3(margin, margin, 0.0f);
+		volume.sliceMax += glm::vec3(margin, margin, 0.0f);
+	}
+	return volume;
+}
+
+// Inside the light volume, and with the swept test, its box extruded away from the light has
+// to overlap the camera slice: in clip space that is an xy overlap and not starting behind it
+bool isCasterRelevant(const SceneObject& object, const CasterCullVolume& volume) {
+	if (sphereOutsidePlanes(volume.planes, object.boundingSphere) || boxOutsidePlanes(volume.planes, object.boundsMin, object.boundsMax)) {
+		return false;
+	}
+	if (volume.swept) {
+		glm::vec3 corners[8], casterMin, casterMax;
+		getBoxCorners(object.boundsMin, object.boundsMax, corners);
+		getTransformedBounds(volume.lightMatrix, corners, 8, casterMin, casterMax);
+		if (casterMax.x < volume.sliceMin.x || casterMin.x > volume.sliceMax.x || casterMax.y < volume.sliceMin.y || casterMin.y > volume.sliceMax.y) {
+			return false;
+		}
+		// shadows only extend away from the light, towards +z
+		if (casterMin.z > volume.sliceMax.z) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// view distances whose lookups can land in a cascade, the one before it included for the blend band
+glm::vec2 getCascadeSlice(int cascade, float viewNear) {
+	float sliceNear = cascade <= 1 ? viewNear : cascadeSplits[cascade - 2];
+	float sliceFar = cascade == cascadeCount - 1 ? camera_far : cascadeSplits[cascade];
+	return glm::vec2(sliceNear, sliceFar);
+}
+#pragma endregion BOUNDS
+
+// CASTERS_ALL, CASTERS_STATIC or CASTERS_DYNAMIC, only the ones relevant to volume when given
+void displayCasters(GLuint& ID, int casters, const CasterCullVolume* volume = NULL) {
+	bool culling = casterCullingEnabled && volume != NULL;
+	// large scenes take the light volume from the hierarchy, the swept test only runs on its hits
+	std::vector<char> inVolume;
+	if (culling && sceneObjects.size() >= BVH_MIN_OBJECTS) {
+		std::vector<int> candidates;
+		sceneBVH.queryFrustum(volume->planes, candidates);
+		inVolume.assign(sceneObjects.size(), 0);
+		for (size_t i = 0; i < candidates.size(); i++) {
+			inVolume[candidates[i]] = 1;
+		}
+	}
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		if ((casters == CASTERS_STATIC && sceneObjects[i].dynamic) || (casters == CASTERS_DYNAMIC && !sceneObjects[i].dynamic)) {
+			continue;
+		}
+		if (culling && ((!inVolume.empty() && !inVolume[i]) || !isCasterRelevant(sceneObjects[i], *volume))) {
+			castersCulled++;
+			continue;
+		}
+		castersDrawn++;
+		displayNormalObject(ID, sceneObjects[i].pos, *sceneObjects[i].mesh, sceneObjects[i].type, sceneObjects[i].scale);
+	}
+}
+
+// view distances that need shadows, in SDSM mode only the depths visible last frame
+void getShadowedDepthRange(float& viewNear, float& viewFar) {
+	viewNear = camera_near;
+	viewFar = glm::min(camera_far, shadowDistance);
+	// the cached shadow maps can not follow a range that changes every frame
+	if (sdsmEnabled && visibleDepthMin < visibleDepthMax && shadowUpdateMode == SHADOW_UPDATE_FULL) {
+		// a little slack since the range is one frame old
+		float slack = 0.05f * (visibleDepthMax - visibleDepthMin);
+		viewNear = glm::max(camera_near, visibleDepthMin - slack);
+		viewFar = glm::min(camera_far, visibleDepthMax + slack);
+	}
+}
+
+// Reduce the camera depth buffer to its min/max view distance and queue the read back,
+// the result of the previous frame is picked up without waiting on the GPU
+void reduceSceneDepth() {
+	glUseProgram(DepthReduceID);
+	glUniform1f(glGetUniformLocation(DepthReduceID, "cameraNear"), camera_near);
+	glUniform1f(glGetUniformLocation(DepthReduceID, "cameraFar"), camera_far);
+	glActiveTexture(GL_TEXTURE0);
+	glDisable(GL_DEPTH_TEST);
+	for (size_t i = 0; i < depthReduceFBO.size(); i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, depthReduceFBO[i]);
+		glViewport(0, 0, depthReduceSize[i].x, depthReduceSize[i].y);
+		glBindTexture(GL_TEXTURE_2D, i == 0 ? sceneDepth : depthReduceTexture[i - 1]);
+		glUniform1i(glGetUniformLocation(DepthReduceID, "firstPass"), i == 0);
+		renderQuad();
+	}
+	glEnable(GL_DEPTH_TEST);
+
+	int current = depthReduceFrame % 2;
+	int previous = 1 - current;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, depthReducePBO[current]);
+	glReadPixels(0, 0, 1, 1, GL_RG, GL_FLOAT, 0);
+	depthReducePending[current] = true;
+
+	if (depthReducePending[previous]) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, depthReducePBO[previous]);
+		float* range = (float*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if (range != NULL) {
+			// min > max when nothing but background was visible
+			visibleDepthMin = range[0];
+			visibleDepthMax = range[1];
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		depthReducePending[previous] = false;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	depthReduceFrame++;
+}
+
+// Fit the whole scene light projection to where the casters overlap the camera frustum
+// (up to shadowDistance), so every shadow map texel lands on a visible receiver
+void updateLightProjection(glm::mat4 lightView) {
+	glm::vec3 casterMin, casterMax;
+	if (shadowUpdateMode != SHADOW_UPDATE_FULL) {
+		// cached maps are only redone when the projection changes, so it covers every caster and
+		// the paths of the moving ones instead of following the camera
+		getCasterLightBounds(lightView, casterMin, casterMax, true);
+		float padding = 0.01f * (casterMax.z - casterMin.z);
+		lightSpaceMatrix = glm::ortho(casterMin.x, casterMax.x, casterMin.y, casterMax.y, -casterMax.z - padding, -casterMin.z + padding) * lightView;
+		lightDepthRange = glm::vec2(-casterMax.z - padding, -casterMin.z + padding);
+		return;
+	}
+	getCasterLightBounds(lightView, casterMin, casterMax);
+	glm::vec3 frustumCorners[8], viewMin, viewMax;
+	float viewNear, viewFar;
+	getShadowedDepthRange(viewNear, viewFar);
+	getFrustumCorners(viewNear, viewFar, frustumCorners);
+	getTransformedBounds(lightView, frustumCorners, 8, viewMin, viewMax);
+
+	glm::vec3 fitMin = glm::max(casterMin, viewMin);
+	glm::vec3 fitMax = glm::min(casterMax, viewMax);
+	if (fitMin.x >= fitMax.x || fitMin.y >= fitMax.y || fitMin.z >= fitMax.z) {
+		// no caster is visible, keep the whole scene
+		fitMin = casterMin;
+		fitMax = casterMax;
+	}
+	// the light looks down -z, casters between the light and the receivers must stay in range
+	float padding = 0.01f * (casterMax.z - casterMin.z);
+	float nearPlane = -casterMax.z - padding;
+	float farPlane = -fitMin.z + padding;
+	lightSpaceMatrix = glm::ortho(fitMin.x, fitMax.x, fitMin.y, fitMax.y, nearPlane, farPlane) * lightView;
+	lightDepthRange = glm::vec2(nearPlane, farPlane);
+}
+
+// Split the camera frustum up to shadowDistance with the practical split scheme and fit
+// a texel snapped light projection around each slice
+void updateCascades(glm::mat4 lightView) {
+	// cached cascades move in coarse steps, see below, and their depth covers the swept casters
+	bool cached = shadowUpdateMode != SHADOW_UPDATE_FULL;
+	glm::vec3 casterMin, casterMax;
+	getCasterLightBounds(lightView, casterMin, casterMax, cached);
+
+	float viewNear, viewFar;
+	getShadowedDepthRange(viewNear, viewFar);
+	float splitNear = viewNear;
+	for (int c = 0; c < cascadeCount; c++) {
+		float p = (c + 1) / float(cascadeCount);
+		float logSplit = viewNear * pow(viewFar / viewNear, p);
+		float uniformSplit = viewNear + (viewFar - viewNear) * p;
+		float splitFar = cascadeSplitLambda * logSplit + (1.0f - cascadeSplitLambda) * uniformSplit;
+		cascadeSplits[c] = splitFar;
+
+		glm::vec3 corners[8];
+		glm::vec3 center = glm::vec3(0.0f);
+		getFrustumCorners(splitNear, splitFar, corners);
+		for (int i = 0; i < 8; i++) {
+			center += corners[i];
+		}
+		center /= 8.0f;
+
+		// a bounding sphere keeps the projection size constant while the camera turns
+		float radius = 0.0f;
+		for (int i = 0; i < 8; i++) {
+			radius = glm::max(radius, glm::length(corners[i] - center));
+		}
+		radius = ceil(radius * 16.0f) / 16.0f;
+
+		// move the projection in whole texels so static shadows don't shimmer
+		glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+		float texelSize = 2.0f * radius / SHADOW_MAP_SIZE;
+		lightCenter.x = floor(lightCenter.x / texelSize) * texelSize;
+		lightCenter.y = floor(lightCenter.y / texelSize) * texelSize;
+		if (cached) {
+			// a quarter radius larger, the cascade then only has to move in steps of that quarter,
+			// a whole number of texels, and camera motion within a step keeps the cache
+			radius *= 1.25f;
+			texelSize = 2.0f * radius / SHADOW_MAP_SIZE;
+			float step = 2 * (SHADOW_MAP_SIZE / 20) * texelSize;
+			lightCenter.x = floor(lightCenter.x / step) * step + 0.5f * step;
+			lightCenter.y = floor(lightCenter.y / step) * step + 0.5f * step;
+		}
+
+		// depth covers every caster towards the light, and stops at the slice or the last caster
+		float padding = 0.01f * (casterMax.z - casterMin.z);
+		float nearPlane = -casterMax.z - padding;
+		float farPlane = glm::max(glm::min(-lightCenter.z + radius, -casterMin.z), -casterMax.z) + padding;
+		if (cached) {
+			farPlane = -casterMin.z + padding;
+		}
+		glm::mat4 lightProjection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+			lightCenter.y - radius, lightCenter.y + radius, nearPlane, farPlane);
+		cascadeMatrices[c] = lightProjection * lightView;
+		cascadeDepthRanges[c] = glm::vec2(nearPlane, farPlane);
+		splitNear = splitFar;
+	}
+}
+
+#pragma region SHADOW_ATLAS
+// a ring of colored spot lights around the scene, all aimed at the middle
+void createSpotLights() {
+	for (int i = 0; i < MAX_ATLAS_LIGHTS; i++) {
+		float a = glm::radians(360.0f * i / MAX_ATLAS_LIGHTS);
+		float r = 7.0f + 2.0f * (i % 2);
+		SpotLight light;
+		light.position = glm::vec3(r * cos(a), 3.0f + (i % 3), r * sin(a));
+		light.direction = glm::normalize(glm::vec3(-1.5f, -1.0f, 0.0f) - light.position);
+		float hue = 6.0f * i / MAX_ATLAS_LIGHTS;
+		light.color = 0.6f * glm::clamp(glm::vec3(fabs(hue - 3.0f) - 1.0f, 2.0f - fabs(hue - 2.0f), 2.0f - fabs(hue - 4.0f)), 0.0f, 1.0f);
+		light.angle = 25.0f;
+		light.range = 14.0f;
+		spotLights.push_back(light);
+	}
+}
+
+// Rough screen size in pixels of a light's area of influence, 0 when it is behind the camera
+float getLightImportance(const SpotLight& light) {
+	glm::vec3 viewPos = glm::vec3(view * glm::vec4(light.position + light.direction * (0.5f * light.range), 1.0f));
+	float radius = 0.5f * light.range;
+	if (-viewPos.z < -radius) {
+		return 0.0f;
+	}
+	float distance = glm::max(-viewPos.z, radius);
+	return radius / distance * persp_proj[1][1] * 0.5f * height;
+}
+
+// Shelf packing: a tile goes on the lowest fitting shelf, or opens a new one on top
+bool allocateAtlasTile(std::vector<AtlasShelf>& shelves, int size, glm::ivec4& rect) {
+	int best = -1;
+	for (size_t i = 0; i < shelves.size(); i++) {
+		if (shelves[i].height >= size && shelves[i].x + size <= SHADOW_ATLAS_SIZE && (best < 0 || shelves[i].height < shelves[best].height)) {
+			best = (int)i;
+		}
+	}
+	if (best < 0) {
+		int top = shelves.empty() ? 0 : shelves.back().y + shelves.back().height;
+		if (top + size > SHADOW_ATLAS_SIZE) {
+			return false;
+		}
+		shelves.push_back({ top, size, 0 });
+		best = (int)shelves.size() - 1;
+	}
+	rect = glm::ivec4(shelves[best].x, shelves[best].y, size, size);
+	shelves[best].x += size;
+	return true;
+}
+
+// Size each light's tile by importance, pack the atlas and upload the lights' block
+void updateShadowAtlas() {
+	std::vector<std::pair<int, int> > tiles; // size, light
+	for (int i = 0; i < atlasLightCount; i++) {
+		int size = ATLAS_MIN_TILE;
+		float importance = getLightImportance(spotLights[i]);
+		while (size * 2 <= ATLAS_MAX_TILE && size * 2 <= importance) {
+			size *= 2;
+		}
+		tiles.push_back(std::make_pair(importance > 0.0f ? size : 0, i));
+	}
+	// biggest first keeps the shelves tight
+	std::sort(tiles.begin(), tiles.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first > b.first; });
+
+	// when a light does not fit every tile is halved and the atlas packed again, so the lights
+	// lose resolution together instead of the last ones losing their shadow
+	for (int scale = 1; ; scale *= 2) {
+		std::vector<AtlasShelf> shelves;
+		bool shrinkable = false;
+		atlasUnshadowedLights = 0;
+		for (size_t t = 0; t < tiles.size(); t++) {
+			int i = tiles[t].second;
+			int size = tiles[t].first == 0 ? 0 : glm::max(tiles[t].first / scale, ATLAS_MIN_TILE);
+			shrinkable = shrinkable || size > ATLAS_MIN_TILE;
+			atlasLightRects[i] = glm::ivec4(0);
+			if (size > 0 && !allocateAtlasTile(shelves, size, atlasLightRects[i])) {
+				atlasUnshadowedLights++;
+			}
+		}
+		if (atlasUnshadowedLights == 0 || !shrinkable) {
+			break;
+		}
+	}
+
+	std::vector<AtlasLightBlock> blocks(atlasLightCount);
+	for (size_t t = 0; t < tiles.size(); t++) {
+		int i = tiles[t].second;
+		glm::ivec4 rect = atlasLightRects[i];
+		const SpotLight& light = spotLights[i];
+		glm::vec3 up = fabs(light.direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		atlasLightMatrices[i] = glm::perspective(glm::radians(2.0f * light.angle), 1.0f, 0.1f, light.range)
+			* glm::lookAt(light.position, light.position + light.direction, up);
+		blocks[i].matrix = atlasLightMatrices[i];
+		blocks[i].rect = glm::vec4(rect.x, rect.y, rect.z, rect.w) / float(SHADOW_ATLAS_SIZE);
+		blocks[i].position = glm::vec4(light.position, light.range);
+		blocks[i].direction = glm::vec4(light.direction, cos(glm::radians(light.angle)));
+		blocks[i].color = glm::vec4(light.color, 1.0f);
+	}
+
+	GLint count[4] = { atlasLightCount, 0, 0, 0 };
+	glBindBuffer(GL_UNIFORM_BUFFER, atlasLightsUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(count), count);
+	if (atlasLightCount > 0) {
+		glBufferSubData(GL_UNIFORM_BUFFER, 16, atlasLightCount * sizeof(AtlasLightBlock), &blocks[0]);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// every light renders into its own viewport of the single atlas FBO
+void renderShadowAtlas() {
+	glBindFramebuffer(GL_FRAMEBUFFER, shadowAtlasFBO);
+	glUseProgram(ShadowDepthID);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_SCISSOR_TEST);
+	for (int i = 0; i < atlasLightCount; i++) {
+		glm::ivec4 rect = atlasLightRects[i];
+		if (rect.z == 0) {
+			continue;
+		}
+		glViewport(rect.x, rect.y, rect.z, rect.w);
+		glScissor(rect.x, rect.y, rect.z, rect.w);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glUniformMatrix4fv(glGetUniformLocation(ShadowDepthID, "lightSpaceMatrix"), 1, GL_FALSE, &atlasLightMatrices[i][0][0]);
+		// spot lights are perspective, only their own volume is tested
+		CasterCullVolume volume = getCasterCullVolume(atlasLightMatrices[i], glm::vec2(0.0f));
+		displayCasters(ShadowDepthID, CASTERS_ALL, &volume);
+	}
+	glDisable(GL_SCISSOR_TEST);
+}
+
+// lit programs read the spot lights from the shared block, the atlas from unit 1 and the point light cubes from unit 2
+void setupLitProgram(GLuint ID) {
+	glUseProgram(ID);
+	glUniform1i(glGetUniformLocation(ID, "shadowAtlas"), 1);
+	glUniform1i(glGetUniformLocation(ID, "pointShadowMaps"), 2);
+	glUniform1i(glGetUniformLocation(ID, "shadowMapCompare"), 3);
+	glUniform1i(glGetUniformLocation(ID, "shadowMinMax"), 4);
+	glUniform1i(glGetUniformLocation(ID, "momentSAT"), 5);
+	glUniform1i(glGetUniformLocation(ID, "blueNoise"), 6);
+	glUniform1i(glGetUniformLocation(ID, "penumbraMask"), 7);
+	glUniform1i(glGetUniformLocation(ID, "screenShadowMask"), 8);
+	glUniform1i(glGetUniformLocation(ID, "cameraDepth"), 9);
+	glUniform1i(glGetUniformLocation(ID, "momentMean"), 12);
+	GLuint blockIndex = glGetUniformBlockIndex(ID, "AtlasLights");
+	if (blockIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(ID, blockIndex, ATLAS_LIGHTS_BINDING);
+	}
+}
+#pragma endregion SHADOW_ATLAS
+
+#pragma region POINT_SHADOWS
+void createPointLights() {
+	pointLights.push_back({ glm::vec3(0.0f, 1.5f, 0.0f), glm::vec3(0.8f, 0.7f, 0.5f), 12.0f });
+	pointLights.push_back({ glm::vec3(-4.0f, 0.5f, 1.5f), glm::vec3(0.3f, 0.5f, 0.9f), 10.0f });
+	pointLights.push_back({ glm::vec3(2.5f, 1.0f, -1.0f), glm::vec3(0.9f, 0.3f, 0.3f), 10.0f });
+	pointLights.push_back({ glm::vec3(-2.0f, 2.0f, -4.0f), glm::vec3(0.3f, 0.8f, 0.4f), 10.0f });
+}
+
+// Bit per cube face (+x, -x, +y, -y, +z, -z) whose 90 degree frustum touches the box
+int getCubeFaceMask(glm::vec3 lightPos, float range, glm::vec3 boundsMin, glm::vec3 boundsMax) {
+	glm::vec3 lo = boundsMin - lightPos;
+	glm::vec3 hi = boundsMax - lightPos;
+	// out of range
+	glm::vec3 closest = glm::clamp(glm::vec3(0.0f), lo, hi);
+	if (glm::dot(closest, closest) > range * range) {
+		return 0;
+	}
+	int mask = 0;
+	for (int face = 0; face < 6; face++) {
+		int axis = face / 2;
+		float sign = face % 2 == 0 ? 1.0f : -1.0f;
+		bool inside = true;
+		// each face frustum is bounded by four planes sign * p[axis] >= |p[other]|
+		for (int other = 0; other < 3 && inside; other++) {
+			if (other == axis) {
+				continue;
+			}
+			for (float side = -1.0f; side <= 1.0f; side += 2.0f) {
+				// largest value of sign * p[axis] + side * p[other] over the box
+				float a = sign > 0.0f ? hi[axis] : -lo[axis];
+				float b = side > 0.0f ? hi[other] : -lo[other];
+				if (a + b < 0.0f) {
+					inside = false;
+					break;
+				}
+			}
+		}
+		if (inside) {
+			mask |= 1 << face;
+		}
+	}
+	return mask;
+}
+
+// one draw per caster covers every face of every light it can be seen from
+void renderPointShadows() {
+	glm::mat4 faceMatrices[6 * MAX_POINT_LIGHTS];
+	const glm::vec3 faceDirections[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+	const glm::vec3 faceUps[6] = { glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+	glm::vec4 lightPositions[MAX_POINT_LIGHTS];
+	for (int i = 0; i < pointLightCount; i++) {
+		glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, pointLights[i].range);
+		for (int face = 0; face < 6; face++) {
+			faceMatrices[i * 6 + face] = proj * glm::lookAt(pointLights[i].position, pointLights[i].position + faceDirections[face], faceUps[face]);
+		}
+		lightPositions[i] = glm::vec4(pointLights[i].position, pointLights[i].range);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, pointShadowFBO);
+	glViewport(0, 0, POINT_SHADOW_SIZE, POINT_SHADOW_SIZE);
+	glEnable(GL_DEPTH_TEST);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glUseProgram(PointDepthID);
+	glUniformMatrix4fv(glGetUniformLocation(PointDepthID, "faceMatrices"), 6 * pointLightCount, GL_FALSE, &faceMatrices[0][0][0]);
+	glUniform4fv(glGetUniformLocation(PointDepthID, "pointLightPositions"), pointLightCount, &lightPositions[0][0]);
+	glUniform1i(glGetUniformLocation(PointDepthID, "pointLightCount"), pointLightCount);
+	pointFacesDrawn = 0;
+	// only objects within the range of a light are tested against its faces
+	std::vector<char> inRange(sceneObjects.size(), 0);
+	for (int i = 0; i < pointLightCount; i++) {
+		std::vector<int> nearby;
+		sceneBVH.queryRange(pointLights[i].position, pointLights[i].range, nearby);
+		for (size_t n = 0; n < nearby.size(); n++) {
+			inRange[nearby[n]] = 1;
+		}
+	}
+	for (size_t o = 0; o < sceneObjects.size(); o++) {
+		if (!inRange[o]) {
+			continue;
+		}
+		glm::vec3 boundsMin = sceneObjects[o].boundsMin;
+		glm::vec3 boundsMax = sceneObjects[o].boundsMax;
+		GLint faceMask = 0;
+		for (int i = 0; i < pointLightCount; i++) {
+			faceMask |= getCubeFaceMask(pointLights[i].position, pointLights[i].range, boundsMin, boundsMax) << (i * 6);
+		}
+		if (faceMask == 0) {
+			continue;
+		}
+		for (int bits = faceMask; bits != 0; bits &= bits - 1) {
+			pointFacesDrawn++;
+		}
+		glUniform1i(glGetUniformLocation(PointDepthID, "faceMask"), faceMask);
+		displayNormalObject(PointDepthID, sceneObjects[o].pos, *sceneObjects[o].mesh, sceneObjects[o].type, sceneObjects[o].scale);
+	}
+}
+
+// positions and colors for the point lights in a lit program
+void setPointLightUniforms(GLuint ID) {
+	glm::vec4 positions[MAX_POINT_LIGHTS];
+	glm::vec3 colors[MAX_POINT_LIGHTS];
+	for (int i = 0; i < pointLightCount; i++) {
+		positions[i] = glm::vec4(pointLights[i].position, pointLights[i].range);
+		colors[i] = pointLights[i].color;
+	}
+	glUniform1i(glGetUniformLocation(ID, "pointLightCount"), pointLightCount);
+	if (pointLightCount > 0) {
+		glUniform4fv(glGetUniformLocation(ID, "pointLightPositions"), pointLightCount, &positions[0][0]);
+		glUniform3fv(glGetUniformLocation(ID, "pointLightColors"), pointLightCount, &colors[0][0]);
+	}
+}
+#pragma endregion POINT_SHADOWS
+
+// Points in the unit disk, Poisson by dart throwing or the Vogel golden angle spiral
+std::vector<glm::vec2> createSamplePattern(int pattern, int count) {
+	std::vector<glm::vec2> points;
+	if (pattern == SAMPLE_VOGEL) {
+		for (int i = 0; i < count; i++) {
+			float r = sqrt((i + 0.5f) / count);
+			float theta = i * 2.39996323f;
+			points.push_back(glm::vec2(r * cos(theta), r * sin(theta)));
+		}
+		return points;
+	}
+	// fixed seed, the pattern is the same every run
+	unsigned int seed = 12345u;
+	float minDistance = 2.0f / sqrt((float)count);
+	int failures = 0;
+	while ((int)points.size() < count) {
+		seed = seed * 1664525u + 1013904223u;
+		float u = (seed >> 8) / 16777216.0f * 2.0f - 1.0f;
+		seed = seed * 1664525u + 1013904223u;
+		float v = (seed >> 8) / 16777216.0f * 2.0f - 1.0f;
+		glm::vec2 candidate = glm::vec2(u, v);
+		if (glm::dot(candidate, candidate) > 1.0f) {
+			continue;
+		}
+		bool accepted = true;
+		for (size_t i = 0; i < points.size() && accepted; i++) {
+			accepted = glm::length(points[i] - candidate) >= minDistance;
+		}
+		if (accepted) {
+			points.push_back(candidate);
+			failures = 0;
+		}
+		else if (++failures > 1000) {
+			// too tight for this count, relax the spacing
+			minDistance *= 0.9f;
+			failures = 0;
+		}
+	}
+	return points;
+}
+
+// Upload the current pattern to every PCF and PCSS program, each with its own count,
+// and to the other lit programs for their point light kernel
+void updateSamplePatterns() {
+	for (int v = 0; v < SAMPLE_VARIANTS; v++) {
+		GLuint programs[] = { PCFVariants[v], PCSSVariants[v], screenMaskPrograms[PCFVariants[v]], screenMaskPrograms[PCSSVariants[v]] };
+		std::vector<glm::vec2> points = createSamplePattern(samplePattern, sampleCounts[v]);
+		for (GLuint ID : programs) {
+			glUseProgram(ID);
+			glUniform2fv(glGetUniformLocation(ID, "diskSamples"), sampleCounts[v], &points[0][0]);
+		}
+	}
+	// the default SAMPLE_COUNT of shadowSampling.txt
+	std::vector<glm::vec2> points = createSamplePattern(samplePattern, 16);
+	GLuint others[] = { ShadowMapID, BiasID, VSSMID, MSMID, HWPCFID, GatherPCSSID, ESMID };
+	for (GLuint ID : others) {
+		GLuint programs[] = { ID, screenMaskPrograms[ID] };
+		for (GLuint program : programs) {
+			glUseProgram(program);
+			glUniform2fv(glGetUniformLocation(program, "diskSamples"), 16, &points[0][0]);
+		}
+	}
+	PCFID = PCFVariants[sampleCountIndex];
+	PCSSID = PCSSVariants[sampleCountIndex];
+	if (mode == 3) { ShadowID = PCFID; }
+	else if (mode == 4) { ShadowID = PCSSID; }
+}
+
+// Separable box blur of a moment map into blurTexture[1], through blurTexture[0]
+void blurMomentMap(GLuint source, GLuint* blurFBO, GLuint* blurTexture, GLenum format) {
+	if (computeBlurEnabled) {
+		// each workgroup loads its row or column segment and apron to shared memory once
+		glUseProgram(BlurComputeID);
+		glUniform1i(glGetUniformLocation(BlurComputeID, "radius"), blurRadius);
+		glActiveTexture(GL_TEXTURE0);
+		for (int pass = 0; pass < 2; pass++) {
+			glBindTexture(GL_TEXTURE_2D, pass == 0 ? source : blurTexture[0]);
+			glBindImageTexture(0, blurTexture[pass], 0, GL_FALSE, 0, GL_WRITE_ONLY, format);
+			glUniform2i(glGetUniformLocation(BlurComputeID, "direction"), pass == 0, pass == 1);
+			glDispatchCompute((1024 + BLUR_SEGMENT - 1) / BLUR_SEGMENT, 1024, 1);
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+		return;
+	}
+	glUseProgram(VarianceID);
+	glUniform1i(glGetUniformLocation(VarianceID, "radius"), blurRadius);
+	glBindFramebuffer(GL_FRAMEBUFFER, blurFBO[0]);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source);
+	glUniform1f(glGetUniformLocation(VarianceID, "vertical"), 0.0f);
+	renderQuad();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, blurFBO[1]);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, blurTexture[0]);
+	glUniform1f(glGetUniformLocation(VarianceID, "vertical"), 1.0f);
+	renderQuad();
+}
+
+// Prefix sums of the moments, log2(1024) passes along x then along y
+void buildMomentSAT() {
+	glUseProgram(SATID);
+	glDisable(GL_DEPTH_TEST);
+	glViewport(0, 0, 1024, 1024);
+	glActiveTexture(GL_TEXTURE0);
+	// the 1x1 mip is the mean of the map, the first pass centers the moments on it
+	glBindTexture(GL_TEXTURE_2D, depthMap2);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	GLuint source = depthMap2;
+	int target = 0;
+	for (int axis = 0; axis < 2; axis++) {
+		for (int step = 1; step < 1024; step *= 2) {
+			glBindFramebuffer(GL_FRAMEBUFFER, satFBO[target]);
+			glBindTexture(GL_TEXTURE_2D, source);
+			glUniform1i(glGetUniformLocation(SATID, "firstPass"), source == depthMap2);
+			glUniform2i(glGetUniformLocation(SATID, "offset"), axis == 0 ? step : 0, axis == 1 ? step : 0);
+			renderQuad();
+			source = satTexture[target];
+			satResult = target;
+			target = 1 - target;
+		}
+	}
+	glEnable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Rebuild the min/max pyramid of every cascade layer from depthMap
+void buildMinMaxPyramid() {
+	glUseProgram(MinMaxID);
+	glUniform1i(glGetUniformLocation(MinMaxID, "depthMap"), 0);
+	glUniform1i(glGetUniformLocation(MinMaxID, "minMaxMap"), 1);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthMap);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMinMaxMap);
+	glDisable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, minMaxFBO);
+	for (int level = 0; level < MIN_MAX_LEVELS; level++) {
+		// only the source level is visible to the shader, as its lod 0, so the level being written never feeds back
+		if (level > 0) {
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, level - 1);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, level - 1);
+		}
+		glViewport(0, 0, MIN_MAX_SIZE >> level, MIN_MAX_SIZE >> level);
+		glUniform1i(glGetUniformLocation(MinMaxID, "firstPass"), level == 0);
+		for (int c = 0; c < cascadeCount; c++) {
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, shadowMinMaxMap, level, c);
+			glUniform1i(glGetUniformLocation(MinMaxID, "layer"), c);
+			renderQuad();
+		}
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, MIN_MAX_LEVELS - 1);
+	glActiveTexture(GL_TEXTURE0);
+	glEnable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	minMaxValid = true;
+}
+
+// light matrices and cascade splits for a program that looks up the directional shadow
+void setLightSpaceUniforms(GLuint ID) {
+	glUniformMatrix4fv(glGetUniformLocation(ID, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(ID, "lightSpaceMatrices"), cascadeCount, GL_FALSE, &cascadeMatrices[0][0][0]);
+	glUniform1fv(glGetUniformLocation(ID, "cascadeSplits"), cascadeCount, cascadeSplits);
+	glUniform2fv(glGetUniformLocation(ID, "cascadeDepthRanges"), cascadeCount, &cascadeDepthRanges[0][0]);
+	glUniform1i(glGetUniformLocation(ID, "cascadeCount"), cascadeCount);
+	glUniform1f(glGetUniformLocation(ID, "cascadeBlend"), cascadeBlendBand);
+}
+
+// PCSS, gather PCSS, VSSM and MSM can skip their soft filter outside the penumbra tiles
+bool usesPenumbraMask() {
+	return penumbraMaskEnabled && (mode == 4 || mode == 5 || mode == 6 || mode == 8);
+}
+
+// Screen tiles the widest penumbra of the current mode can cover: its filter radius in shadow map
+// texels, projected at the nearest visible receiver, so the dilation reaches as far as any penumbra
+int getPenumbraDilation() {
+	bool moments = mode == 5 || mode == 6;
+	// MSM and the blurred VSM filter over the blur, PCSS, gather PCSS and SAT VSSM over their blocker search
+	float texels = mode == 6 || (mode == 5 && !satEnabled) ? (float)blurRadius : PENUMBRA_MAX_TEXELS;
+	glm::mat4 matrix = moments ? lightSpaceMatrix : cascadeMatrices[0];
+	float mapSize = moments ? 1024.0f : (float)SHADOW_MAP_SIZE;
+	// the light projection is orthographic, the smaller scale gives the larger texel
+	float scale = glm::min(glm::length(glm::vec3(matrix[0][0], matrix[1][0], matrix[2][0])), glm::length(glm::vec3(matrix[0][1], matrix[1][1], matrix[2][1])));
+	float worldWidth = texels * 2.0f / (scale * mapSize);
+
+	glm::vec3 eye = glm::vec3(camera_pos_x, camera_pos_y, camera_pos_z);
+	float nearest = camera_far;
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		if (i < objectInFrustum.size() && !objectInFrustum[i]) {
+			continue;
+		}
+		glm::vec3 closest = glm::clamp(eye, sceneObjects[i].boundsMin, sceneObjects[i].boundsMax);
+		nearest = glm::min(nearest, glm::length(closest - eye));
+	}
+	nearest = glm::max(nearest, camera_near);
+	float pixels = worldWidth * persp_proj[1][1] * 0.5f * height / nearest;
+	return glm::clamp((int)ceil(pixels / PENUMBRA_TILE), 1, PENUMBRA_MAX_DILATION);
+}
+
+// Hard shadow of the visible surfaces at quarter resolution, then a separable min/max dilation
+// that marks every tile whose neighbourhood mixes lit and shadowed texels as penumbra
+void renderPenumbraMask() {
+	glBindFramebuffer(GL_FRAMEBUFFER, penumbraHardFBO);
+	glViewport(0, 0, width / PENUMBRA_TILE, height / PENUMBRA_TILE);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	glUseProgram(PenumbraMaskID);
+	glUniformMatrix4fv(glGetUniformLocation(PenumbraMaskID, "proj"), 1, GL_FALSE, &persp_proj[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(PenumbraMaskID, "view"), 1, GL_FALSE, &view[0][0]);
+	setLightSpaceUniforms(PenumbraMaskID);
+	glUniform1i(glGetUniformLocation(PenumbraMaskID, "shadowMap"), 0);
+	glUniform1i(glGetUniformLocation(PenumbraMaskID, "momentDepth"), 1);
+	// the moment modes test against the unfiltered moments, their first moment is the depth
+	int maskSource = mode == 5 ? MASK_VARIANCE : mode == 6 ? MASK_MSM : MASK_CASCADES;
+	glUniform1i(glGetUniformLocation(PenumbraMaskID, "maskSource"), maskSource);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthMap);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, mode == 6 ? msmMap : depthMap2);
+	displayScene(PenumbraMaskID, CULL_PASS_PENUMBRA);
+
+	glDisable(GL_DEPTH_TEST);
+	glUseProgram(PenumbraDilateID);
+	penumbraDilation = getPenumbraDilation();
+	glUniform1i(glGetUniformLocation(PenumbraDilateID, "range"), 0);
+	glUniform1i(glGetUniformLocation(PenumbraDilateID, "radius"), penumbraDilation);
+	glActiveTexture(GL_TEXTURE0);
+	for (int pass = 0; pass < 2; pass++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, pass == 0 ? penumbraRangeFBO : penumbraMaskFBO);
+		glBindTexture(GL_TEXTURE_2D, pass == 0 ? penumbraHardShadow : penumbraRange);
+		glUniform2i(glGetUniformLocation(PenumbraDilateID, "direction"), pass == 0, pass == 1);
+		glUniform1i(glGetUniformLocation(PenumbraDilateID, "finalPass"), pass == 1);
+		renderQuad();
+	}
+	glEnable(GL_DEPTH_TEST);
+	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+}
+
+// Per-program state of the directional, spot and point light lookups, for the lit pass and its mask pass
+void setShadowUniforms(GLuint ID, bool penumbraMaskActive, bool countPCF) {
+	glUniformMatrix4fv(glGetUniformLocation(ID, "proj"), 1, GL_FALSE, &persp_proj[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(ID, "view"), 1, GL_FALSE, &view[0][0]);
+	glUniform3f(glGetUniformLocation(ID, "viewPos"), camera_pos_x, camera_pos_y, camera_pos_z);
+	glUniform3f(glGetUniformLocation(ID, "lightPos"), light_pos_x, light_pos_y, light_pos_z);
+	setLightSpaceUniforms(ID);
+	setPointLightUniforms(ID);
+	glUniform1i(glGetUniformLocation(ID, "usePenumbraMask"), penumbraMaskActive);
+	glUniform1i(glGetUniformLocation(ID, "penumbraTile"), PENUMBRA_TILE);
+	if (mode == 3 || mode == 4) {
+		// the temporal filter needs a pattern it can rotate, the grid falls back to the Poisson disk
+		glUniform1i(glGetUniformLocation(ID, "diskSampling"), samplePattern != SAMPLE_GRID || temporalShadowsEnabled);
+		glUniform1f(glGetUniformLocation(ID, "sampleRotationOffset"), temporalShadowsEnabled ? fmod(temporalFrame * 0.618034f, 1.0f) : 0.0f);
+		glUniform1i(glGetUniformLocation(ID, "adaptivePCF"), adaptivePCFEnabled);
+		glUniform1i(glGetUniformLocation(ID, "pcfDebugCounters"), countPCF);
+	}
+	if (mode == 4 || mode == 8) {
+		glUniform1i(glGetUniformLocation(ID, "useMinMax"), minMaxEnabled);
+		glUniform1i(glGetUniformLocation(ID, "minMaxLevels"), MIN_MAX_LEVELS);
+	}
+	if (mode == 7) {
+		glUniform1i(glGetUniformLocation(ID, "pcfKernelSize"), pcfKernelSize);
+	}
+	if (mode == 9 || mode == 10) {
+		glm::vec3 exponents = getExponents();
+		glUniform1i(glGetUniformLocation(ID, "evsm"), mode == 10);
+		glUniform3fv(glGetUniformLocation(ID, "exponents"), 1, &exponents[0]);
+	}
+	else if (mode == 5) {
+		glUniform1i(glGetUniformLocation(ID, "useSAT"), satEnabled);
+		glUniform2fv(glGetUniformLocation(ID, "lightDepthRange"), 1, &lightDepthRange[0]);
+	}
+}
+
+// Shadow maps of the current mode on their texture units, unit 0 last
+void bindShadowTextures(bool penumbraMaskActive) {
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, shadowAtlas);
+	if (penumbraMaskActive) {
+		glActiveTexture(GL_TEXTURE7);
+		glBindTexture(GL_TEXTURE_2D, penumbraMask);
+	}
+	bool pointShadowsActive = pointShadowsSupported && pointLightCount > 0;
+	if (pointShadowsActive) {
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, pointShadowMaps);
+	}
+	// the point light kernel rotates its disk with the same noise
+	if (mode == 3 || mode == 4 || pointShadowsActive) {
+		glActiveTexture(GL_TEXTURE6);
+		glBindTexture(GL_TEXTURE_2D, blueNoiseTexture);
+	}
+	if (mode == 4 || mode == 8) {
+		glActiveTexture(GL_TEXTURE4);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMinMaxMap);
+	}
+	if (mode == 7) {
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, depthMap);
+		glBindSampler(3, shadowCompareSampler);
+	}
+	if (mode == 5) {
+		glActiveTexture(GL_TEXTURE5);
+		glBindTexture(GL_TEXTURE_2D, satTexture[satResult]);
+		glActiveTexture(GL_TEXTURE12);
+		glBindTexture(GL_TEXTURE_2D, depthMap2);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	if (mode == 6) { glBindTexture(GL_TEXTURE_2D, msmBlurTexture[1]); }
+	else if (mode == 9 || mode == 10) { glBindTexture(GL_TEXTURE_2D, expBlurTexture[1]); }
+	else if (mode == 5) { glBindTexture(GL_TEXTURE_2D, varianceTexture[1]); }
+	else { glBindTexture(GL_TEXTURE_2D_ARRAY, depthMap); }
+}
+
+// the CPU copy above the read back level, built like the GPU levels
+void buildHiZLevels() {
+	hiZLevels.resize(1);
+	hiZLevelSize.resize(1);
+	while (hiZLevelSize.back().x > 1 || hiZLevelSize.back().y > 1) {
+		glm::ivec2 sourceSize = hiZLevelSize.back();
+		glm::ivec2 size = glm::ivec2(glm::max(sourceSize.x / 2, 1), glm::max(sourceSize.y / 2, 1));
+		std::vector<float> level(size.x * size.y);
+		for (int y = 0; y < size.y; y++) {
+			for (int x = 0; x < size.x; x++) {
+				// odd sizes fold their last row and column into the texels before them
+				int lastX = glm::min(x * 2 + (x * 2 + 3 == sourceSize.x ? 2 : 1), sourceSize.x - 1);
+				int lastY = glm::min(y * 2 + (y * 2 + 3 == sourceSize.y ? 2 : 1), sourceSize.y - 1);
+				float depth = 0.0f;
+				for (int sy = y * 2; sy <= lastY; sy++) {
+					for (int sx = x * 2; sx <= lastX; sx++) {
+						depth = glm::max(depth, hiZLevels.back()[sy * sourceSize.x + sx]);
+					}
+				}
+				level[y * size.x + x] = depth;
+			}
+		}
+		hiZLevels.push_back(level);
+		hiZLevelSize.push_back(size);
+	}
+}
+
+// Whether last frame's pyramid hides the object, its box is projected with the camera the
+// pyramid was rendered with. Same level choice as the GPU retest, counting the levels on the GPU
+bool isOccludedHiZ(const SceneObject& object) {
+	glm::vec3 corners[8];
+	getBoxCorners(object.boundsMin, object.boundsMax, corners);
+	glm::vec2 rectMin = glm::vec2(1.0f);
+	glm::vec2 rectMax = glm::vec2(0.0f);
+	float nearest = 1.0f;
+	for (int i = 0; i < 8; i++) {
+		glm::vec4 clip = hiZViewProj * glm::vec4(corners[i], 1.0f);
+		if (clip.w <= 0.0f) {
+			return false;
+		}
+		glm::vec3 window = glm::vec3(clip) / clip.w * 0.5f + 0.5f;
+		rectMin = glm::min(rectMin, glm::vec2(window));
+		rectMax = glm::max(rectMax, glm::vec2(window));
+		nearest = glm::min(nearest, window.z);
+	}
+	rectMin = glm::clamp(rectMin, 0.0f, 1.0f);
+	rectMax = glm::clamp(rectMax, 0.0f, 1.0f);
+	glm::ivec2 pixelMin = glm::ivec2(int(rectMin.x * width), int(rectMin.y * height));
+	glm::ivec2 pixelMax = glm::ivec2(int(rectMax.x * width), int(rectMax.y * height));
+	float extent = (float)glm::max(pixelMax.x - pixelMin.x, pixelMax.y - pixelMin.y);
+	int level = glm::max((int)ceil(log2(glm::max(extent, 1.0f))) - 1, 0);
+	int cpuLevel = glm::clamp(level - hiZReadbackLevel, 0, (int)hiZLevels.size() - 1);
+	int shift = hiZReadbackLevel + cpuLevel + 1;
+	glm::ivec2 size = hiZLevelSize[cpuLevel];
+	float farthest = 0.0f;
+	for (int y = glm::min(pixelMin.y >> shift, size.y - 1); y <= glm::min(pixelMax.y >> shift, size.y - 1); y++) {
+		for (int x = glm::min(pixelMin.x >> shift, size.x - 1); x <= glm::min(pixelMax.x >> shift, size.x - 1); x++) {
+			farthest = glm::max(farthest, hiZLevels[cpuLevel][y * size.x + x]);
+		}
+	}
+	return nearest > farthest;
+}
+
+// first pass of the occlusion culling, marks the objects in the frustum that last frame's pyramid hides
+void cullHiZ() {
+	objectHiZRetest.assign(sceneObjects.size(), 0);
+	if (!hiZEnabled || !hiZValid) {
+		return;
+	}
+	while (hiZQueries.size() < sceneObjects.size()) {
+		GLuint query;
+		glGenQueries(1, &query);
+		hiZQueries.push_back(query);
+	}
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		if (objectInFrustum[i] && isOccludedHiZ(sceneObjects[i])) {
+			objectHiZRetest[i] = 1;
+		}
+	}
+}
+
+void buildHiZ() {
+	glUseProgram(HiZID);
+	glUniform1i(glGetUniformLocation(HiZID, "source"), HIZ_UNIT);
+	glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+	glDisable(GL_DEPTH_TEST);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	for (size_t i = 0; i < hiZFBO.size(); i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, hiZFBO[i]);
+		glViewport(0, 0, hiZSize[i].x, hiZSize[i].y);
+		if (i == 0) {
+			glBindTexture(GL_TEXTURE_2D, sceneDepth);
+		}
+		else {
+			// only the level below is visible to the shader, as its lod 0, while the next one is written
+			glBindTexture(GL_TEXTURE_2D, hiZTexture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)i - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)i - 1);
+		}
+		renderQuad();
+	}
+	glBindTexture(GL_TEXTURE_2D, hiZTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)hiZSize.size() - 1);
+	glActiveTexture(GL_TEXTURE0);
+	glEnable(GL_DEPTH_TEST);
+
+	// picked up next frame for the CPU test, without waiting on the GPU
+	int current = hiZFrame % 2;
+	int previous = 1 - current;
+	glm::ivec2 readbackSize = hiZSize[hiZReadbackLevel];
+	glBindFramebuffer(GL_FRAMEBUFFER, hiZFBO[hiZReadbackLevel]);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, hiZPBO[current]);
+	glReadPixels(0, 0, readbackSize.x, readbackSize.y, GL_RED, GL_FLOAT, 0);
+	hiZPending[current] = true;
+	hiZPendingViewProj[current] = persp_proj * view;
+	if (hiZPending[previous]) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, hiZPBO[previous]);
+		float* depths = (float*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if (depths != NULL) {
+			hiZLevels.resize(1);
+			hiZLevelSize.resize(1);
+			hiZLevels[0].assign(depths, depths + readbackSize.x * readbackSize.y);
+			hiZLevelSize[0] = readbackSize;
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			buildHiZLevels();
+			hiZViewProj = hiZPendingViewProj[previous];
+			hiZValid = true;
+		}
+		hiZPending[previous] = false;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	hiZFrame++;
+}
+
+// Second pass of the occlusion culling, after the pre-pass drew what passed the first. The
+// objects last frame's pyramid hid are tested against this frame's, one query each, and the
+// newly disoccluded ones added to the depth buffer. The pyramid is not rebuilt for them, which
+// only sends more objects to the retest next frame.
+void renderHiZRetests() {
+	buildHiZ();
+	bool retests = false;
+	for (size_t i = 0; i < objectHiZRetest.size(); i++) {
+		retests = retests || objectHiZRetest[i];
+	}
+	if (!retests) {
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+	glViewport(0, 0, 1, 1);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_DEPTH_TEST);
+	glUseProgram(HiZTestID);
+	glm::mat4 viewProj = persp_proj * view;
+	glUniformMatrix4fv(glGetUniformLocation(HiZTestID, "viewProj"), 1, GL_FALSE, &viewProj[0][0]);
+	glUniform1i(glGetUniformLocation(HiZTestID, "hiZ"), HIZ_UNIT);
+	glUniform1i(glGetUniformLocation(HiZTestID, "hiZLevels"), (GLint)hiZSize.size());
+	glUniform2f(glGetUniformLocation(HiZTestID, "screenSize"), (float)width, (float)height);
+	glActiveTexture(GL_TEXTURE0 + HIZ_UNIT);
+	glBindTexture(GL_TEXTURE_2D, hiZTexture);
+	glActiveTexture(GL_TEXTURE0);
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		if (!objectHiZRetest[i]) {
+			continue;
+		}
+		glUniform3fv(glGetUniformLocation(HiZTestID, "boundsMin"), 1, &sceneObjects[i].boundsMin[0]);
+		glUniform3fv(glGetUniformLocation(HiZTestID, "boundsMax"), 1, &sceneObjects[i].boundsMax[0]);
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, hiZQueries[i]);
+		renderQuad();
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+	}
+
+	glViewport(0, 0, width, height);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glUseProgram(DepthPrePassID);
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		if (!objectHiZRetest[i]) {
+			continue;
+		}
+		glBeginConditionalRender(hiZQueries[i], GL_QUERY_WAIT);
+		displayNormalObject(DepthPrePassID, sceneObjects[i].pos, *sceneObjects[i].mesh, sceneObjects[i].type, sceneObjects[i].scale);
+		glEndConditionalRender();
+	}
+}
+
+// Picks up the query results that are ready and decides which heavy objects get a box query
+// this frame, after cullHiZ since its retests already are conditional
+void updateOcclusionQueries() {
+	occlusionFrame++;
+	objectQueried.assign(sceneObjects.size(), 0);
+	occlusionQueriesIssued = 0;
+	occlusionHidden = 0;
+	if (!occlusionQueriesEnabled) {
+		return;
+	}
+	while (occlusionQueryStates.size() < sceneObjects.size()) {
+		OcclusionQueryState state;
+		glGenQueries(2, state.queries);
+		state.pending[0] = state.pending[1] = false;
+		state.visible = true;
+		state.hiddenResults = 0;
+		occlusionQueryStates.push_back(state);
+	}
+	int slot = occlusionFrame % 2;
+	glm::vec3 cameraPos = glm::vec3(camera_pos_x, camera_pos_y, camera_pos_z);
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		OcclusionQueryState& state = occlusionQueryStates[i];
+		// this frame's slot holds the older query
+		for (int s = 0; s < 2; s++) {
+			GLuint query = state.queries[(slot + s) % 2];
+			if (!state.pending[(slot + s) % 2]) {
+				continue;
+			}
+			GLuint available = 0;
+			glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				continue;
+			}
+			GLuint visible = 0;
+			glGetQueryObjectuiv(query, GL_QUERY_RESULT, &visible);
+			state.pending[(slot + s) % 2] = false;
+			if (visible) {
+				state.visible = true;
+				state.hiddenResults = 0;
+			}
+			else if (++state.hiddenResults >= OCCLUSION_HIDE_RESULTS) {
+				state.visible = false;
+			}
+		}
+		if (!state.visible) {
+			occlusionHidden++;
+		}
+
+		const SceneObject& object = sceneObjects[i];
+		if (object.mesh->mPointCount < OCCLUSION_QUERY_MIN_VERTICES || !objectInFrustum[i] || objectHiZRetest[i]) {
+			continue;
+		}
+		// a box the near plane cuts into can not be tested
+		glm::vec3 closest = glm::clamp(cameraPos, object.boundsMin, object.boundsMax);
+		if (glm::length(closest - cameraPos) < 2.0f * camera_near) {
+			continue;
+		}
+		// lagging more than a frame behind, drawn without a query rather than waiting
+		if (state.pending[slot]) {
+			continue;
+		}
+		if (state.visible && (occlusionFrame + i) % OCCLUSION_QUERY_INTERVAL != 0) {
+			continue;
+		}
+		objectQueried[i] = 1;
+		occlusionQueriesIssued++;
+	}
+}
+
+// Box queries against the pre-pass depth, then the heavy meshes into it, which the GPU skips
+// when the result is in and their box was hidden, or draws anyway when it is not
+void renderOcclusionQueries() {
+	if (occlusionQueriesIssued == 0) {
+		return;
+	}
+	int slot = occlusionFrame % 2;
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+	glViewport(0, 0, width, height);
+	glUseProgram(DepthPrePassID);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		if (!objectQueried[i]) {
+			continue;
+		}
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), sceneObjects[i].boundsMin);
+		model = glm::scale(model, sceneObjects[i].boundsMax - sceneObjects[i].boundsMin);
+		generateObjectBufferMesh(DepthPrePassID, occlusionBox);
+		glUniformMatrix4fv(glGetUniformLocation(DepthPrePassID, "model"), 1, GL_FALSE, &model[0][0]);
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, occlusionQueryStates[i].queries[slot]);
+		glDrawArrays(GL_TRIANGLES, 0, occlusionBox.mPointCount);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		occlusionQueryStates[i].pending[slot] = true;
+	}
+	glDepthMask(GL_TRUE);
+	for (size_t i = 0; i < sceneObjects.size(); i++) {
+		if (!objectQueried[i]) {
+			continue;
+		}
+		glBeginConditionalRender(occlusionQueryStates[i].queries[slot], GL_QUERY_NO_WAIT);
+		displayNormalObject(DepthPrePassID, sceneObjects[i].pos, *sceneObjects[i].mesh, sceneObjects[i].type, sceneObjects[i].scale);
+		glEndConditionalRender();
+	}
+}
+
+// Camera depth only, drawn with the position-only build of the lit pass's vertex shader so the
+// lit pass can test GL_LEQUAL against it
+void renderDepthPrePass() {
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+	glViewport(0, 0, width, height);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glUseProgram(DepthPrePassID);
+	glUniformMatrix4fv(glGetUniformLocation(DepthPrePassID, "proj"), 1, GL_FALSE, &persp_proj[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(DepthPrePassID, "view"), 1, GL_FALSE, &view[0][0]);
+	displayScene(DepthPrePassID, CULL_PASS_PREPASS);
+	if (hiZEnabled) {
+		renderHiZRetests();
+	}
+	renderOcclusionQueries();
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// Blend this frame's mask into the reprojected history, returns the texture holding the result.
+// A moved light or another shadow mode changes every shadow, so both drop the history. Camera motion
+// also refits the light projection, but that only resamples the same shadows and reprojection handles it
+GLuint resolveTemporalShadows(const glm::mat4& invViewProj) {
+	glm::vec3 lightPos = glm::vec3(light_pos_x, light_pos_y, light_pos_z);
+	if (lightPos != temporalPrevLightPos || mode != temporalPrevMode) {
+		temporalHistoryValid = false;
+	}
+	int target = 1 - temporalHistory;
+	glBindFramebuffer(GL_FRAMEBUFFER, temporalFBO[target]);
+	glViewport(0, 0, width, height);
+	glUseProgram(TemporalID);
+	glUniform1i(glGetUniformLocation(TemporalID, "currentMask"), 8);
+	glUniform1i(glGetUniformLocation(TemporalID, "cameraDepth"), 9);
+	glUniform1i(glGetUniformLocation(TemporalID, "history"), 10);
+	glUniformMatrix4fv(glGetUniformLocation(TemporalID, "invViewProj"), 1, GL_FALSE, &invViewProj[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(TemporalID, "prevViewProj"), 1, GL_FALSE, &temporalPrevViewProj[0][0]);
+	glUniform2f(glGetUniformLocation(TemporalID, "cameraRange"), camera_near, camera_far);
+	glUniform1i(glGetUniformLocation(TemporalID, "historyValid"), temporalHistoryValid);
+	glActiveTexture(GL_TEXTURE8);
+	glBindTexture(GL_TEXTURE_2D, screenMaskTexture[0]);
+	glActiveTexture(GL_TEXTURE10);
+	glBindTexture(GL_TEXTURE_2D, temporalTexture[temporalHistory]);
+	renderQuad();
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	temporalHistory = target;
+	temporalHistoryValid = true;
+	temporalPrevViewProj = persp_proj * view;
+	temporalPrevLightPos = lightPos;
+	temporalPrevMode = mode;
+	temporalFrame++;
+	return temporalTexture[target];
+}
+
+// Directional occlusion per pixel from the camera depth, into screenMaskTexture[0] on unit 8
+void renderScreenShadowMask(bool penumbraMaskActive, bool countPCF) {
+	GLuint maskID = screenMaskPrograms[ShadowID];
+	// history makes up for the taps, so the temporal filter always takes the smallest variant
+	if (temporalShadowsEnabled && mode == 3) { maskID = screenMaskPrograms[PCFVariants[0]]; }
+	else if (temporalShadowsEnabled && mode == 4) { maskID = screenMaskPrograms[PCSSVariants[0]]; }
+	int level = screenShadowMaskHalfRes ? 1 : 0;
+	glm::mat4 invViewProj = glm::inverse(persp_proj * view);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenMaskFBO[level]);
+	glViewport(0, 0, width >> level, height >> level);
+	glDisable(GL_DEPTH_TEST);
+	glUseProgram(maskID);
+	setShadowUniforms(maskID, penumbraMaskActive, countPCF);
+	glUniform1i(glGetUniformLocation(maskID, "penumbraTile"), PENUMBRA_TILE >> level);
+	glUniformMatrix4fv(glGetUniformLocation(maskID, "invViewProj"), 1, GL_FALSE, &invViewProj[0][0]);
+	glUniform2f(glGetUniformLocation(maskID, "cameraRange"), camera_near, camera_far);
+	glActiveTexture(GL_TEXTURE9);
+	glBindTexture(GL_TEXTURE_2D, sceneDepth);
+	renderQuad();
+	if (level == 1) {
+		glBindFramebuffer(GL_FRAMEBUFFER, screenMaskFBO[0]);
+		glViewport(0, 0, width, height);
+		glUseProgram(MaskUpsampleID);
+		glUniform1i(glGetUniformLocation(MaskUpsampleID, "lowResMask"), 8);
+		glUniform1i(glGetUniformLocation(MaskUpsampleID, "cameraDepth"), 9);
+		glUniform2f(glGetUniformLocation(MaskUpsampleID, "cameraRange"), camera_near, camera_far);
+		glActiveTexture(GL_TEXTURE8);
+		glBindTexture(GL_TEXTURE_2D, screenMaskTexture[1]);
+		renderQuad();
+	}
+	GLuint result = screenMaskTexture[0];
+	if (temporalShadowsEnabled) {
+		result = resolveTemporalShadows(invViewProj);
+	}
+	// the lit pass writes to the framebuffer that owns sceneDepth
+	glActiveTexture(GL_TEXTURE9);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE8);
+	glBindTexture(GL_TEXTURE_2D, result);
+	glActiveTexture(GL_TEXTURE0);
+	glEnable(GL_DEPTH_TEST);
+}
+
+// VSSM, MSM, ESM and EVSM filter a single moment map instead of the cascades
+bool isMomentMode() {
+	return mode == 5 || mode == 6 || mode == 9 || mode == 10;
+}
+
+// Re-rasterize only where casters moved: per layer, the union of each moved caster's old
+// and new rectangle is scissored, cleared and redrawn with every caster that overlaps it
+int updateShadowMapRegions(const ShadowCache& cache) {
+	int regions = 0;
+	glEnable(GL_SCISSOR_TEST);
+	for (int c = 0; c < cascadeCount; c++) {
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMap, 0, c);
+		glUniformMatrix4fv(glGetUniformLocation(ShadowDepthID, "lightSpaceMatrix"), 1, GL_FALSE, &cascadeMatrices[c][0][0]);
+		for (size_t i = 0; i < sceneObjects.size(); i++) {
+			if (cache.previousModels[i] == cache.models[i]) {
+				continue;
+			}
+			glm::ivec4 before = getShadowMapRect(*sceneObjects[i].mesh, cache.previousModels[i], cascadeMatrices[c]);
+			glm::ivec4 after = getShadowMapRect(*sceneObjects[i].mesh, cache.models[i], cascadeMatrices[c]);
+			glm::ivec4 dirty = glm::ivec4(glm::min(before.x, after.x), glm::min(before.y, after.y), glm::max(before.z, after.z), glm::max(before.w, after.w));
+			if (before.x >= before.z) { dirty = after; }
+			if (after.x >= after.z) { dirty = before; }
+			if (dirty.x >= dirty.z || dirty.y >= dirty.w) {
+				continue;
+			}
+			glScissor(dirty.x, dirty.y, dirty.z - dirty.x, dirty.w - dirty.y);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			for (size_t j = 0; j < sceneObjects.size(); j++) {
+				if (rectsOverlap(dirty, getShadowMapRect(*sceneObjects[j].mesh, cache.models[j], cascadeMatrices[c]))) {
+					displayNormalObject(ShadowDepthID, sceneObjects[j].pos, *sceneObjects[j].mesh, sceneObjects[j].type, sceneObjects[j].scale);
+				}
+			}
+			regions++;
+		}
+	}
+	glDisable(GL_SCISSOR_TEST);
+	return regions;
+}
+
+// Read the timestamps of the slot about to be reused, then record this frame into it.
+// A slot still in flight is left alone and the frame goes untimed rather than waiting on the gpu
+void beginGpuTimers() {
+	GLuint* queries = gpuTimerQueries[gpuTimerFrame];
+	if (gpuTimerPending[gpuTimerFrame]) {
+		for (int i = 0; i < GPU_TIMESTAMPS; i++) {
+			GLuint available = 0;
+			glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				gpuTimerRecording = false;
+				return;
+			}
+		}
+		GLuint64 stamps[GPU_TIMESTAMPS];
+		for (int i = 0; i < GPU_TIMESTAMPS; i++) {
+			glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &stamps[i]);
+		}
+		for (int i = 1; i < GPU_TIMESTAMPS; i++) {
+			gpuPassTimes[i - 1] = (stamps[i] - stamps[i - 1]) / 1000000.0f;
+		}
+		gpuTimerPending[gpuTimerFrame] = false;
+	}
+	gpuTimerRecording = true;
+	glQueryCounter(queries[GPU_TIMER_START], GL_TIMESTAMP);
+}
+
+void markGpuTimer(int stamp) {
+	if (gpuTimerRecording) {
+		glQueryCounter(gpuTimerQueries[gpuTimerFrame][stamp], GL_TIMESTAMP);
+	}
+}
+
+void endGpuTimers() {
+	if (gpuTimerRecording) {
+		glQueryCounter(gpuTimerQueries[gpuTimerFrame][GPU_TIMER_LIT], GL_TIMESTAMP);
+		gpuTimerPending[gpuTimerFrame] = true;
+		gpuTimerFrame = (gpuTimerFrame + 1) % GPU_TIMER_FRAMES;
+	}
+}
+
+void display() {
+	//rotate_x += Delta;
+	//camera_pos_x = 10.0f * cos(glm::radians(rotate_x));
+	//camera_pos_z = 10.0f * sin(glm::radians(rotate_x));
+	if (animateObjects) {
+		animateScene();
+	}
+	updateObjectBounds();
+	castersDrawn = 0;
+	castersCulled = 0;
+
+	view = glm::lookAt(glm::vec3(camera_pos_x, camera_pos_y, camera_pos_z), // Camera is at (x,y,z), in World Space
+		   glm::vec3(0, 0, 0), // and looks at the origin 
+		   glm::vec3(0, 1, 0));  // Head is up (set to 0,-1,0 to look upside-down)
+	cullCameraFrustum(persp_proj * view);
+	resetCullCounters();
+	glm::mat4 lightView = glm::lookAt(glm::vec3(light_pos_x, light_pos_y, light_pos_z), glm::vec3(0.0f), glm::vec3(1.0));
+	updateLightProjection(lightView);
+	float viewNear, viewFar;
+	getShadowedDepthRange(viewNear, viewFar);
+	if (cascadeCount > 1) {
+		updateCascades(lightView);
+	}
+	else {
+		cascadeMatrices[0] = lightSpaceMatrix;
+		cascadeDepthRanges[0] = lightDepthRange;
+		cascadeSplits[0] = camera_far;
+	}
+
+	beginGpuTimers();
+	if (!isMomentMode()) {
+		// 1. get depth map, one layer per cascade
+		bool staticDirty, dynamicDirty;
+		checkShadowCache(depthMapCache, cascadeMatrices, cascadeCount, staticDirty, dynamicDirty);
+		glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+		glUseProgram(ShadowDepthID);
+		glEnable(GL_DEPTH_TEST);
+		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+		if (shadowUpdateMode == SHADOW_UPDATE_FULL || (shadowUpdateMode == SHADOW_UPDATE_PARTIAL && depthMapCache.lightChanged)) {
+			glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+			for (int c = 0; c < cascadeCount; c++) {
+				glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMap, 0, c);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				glUniformMatrix4fv(glGetUniformLocation(ShadowDepthID, "lightSpaceMatrix"), 1, GL_FALSE, &cascadeMatrices[c][0][0]);
+				// the swept test depends on the camera, so cached maps, which the camera does not invalidate, keep every caster
+				CasterCullVolume volume = getCasterCullVolume(cascadeMatrices[c], shadowUpdateMode == SHADOW_UPDATE_FULL ? getCascadeSlice(c, viewNear) : glm::vec2(0.0f));
+				displayCasters(ShadowDepthID, CASTERS_ALL, &volume);
+			}
+			shadowUpdateStatus = "full";
+		}
+		else if (shadowUpdateMode == SHADOW_UPDATE_PARTIAL) {
+			// the shadow map itself is the cache, only the moved casters' regions are redone
+			glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+			int regions = (staticDirty || dynamicDirty) ? updateShadowMapRegions(depthMapCache) : 0;
+			shadowUpdateStatus = "partial, " + to_string(regions) + " regions";
+		}
+		else {
+			if (staticDirty) {
+				glBindFramebuffer(GL_FRAMEBUFFER, staticDepthMapFBO);
+				for (int c = 0; c < cascadeCount; c++) {
+					glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticDepthMap, 0, c);
+					glClear(GL_DEPTH_BUFFER_BIT);
+					glUniformMatrix4fv(glGetUniformLocation(ShadowDepthID, "lightSpaceMatrix"), 1, GL_FALSE, &cascadeMatrices[c][0][0]);
+					CasterCullVolume volume = getCasterCullVolume(cascadeMatrices[c], glm::vec2(0.0f));
+					displayCasters(ShadowDepthID, CASTERS_STATIC, &volume);
+				}
+			}
+			if (staticDirty || dynamicDirty) {
+				// copy the static layer, then add the dynamic casters on top
+				for (int c = 0; c < cascadeCount; c++) {
+					glBindFramebuffer(GL_READ_FRAMEBUFFER, staticDepthMapFBO);
+					glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticDepthMap, 0, c);
+					glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthMapFBO);
+					glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMap, 0, c);
+					glBlitFramebuffer(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+					glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+					glUniformMatrix4fv(glGetUniformLocation(ShadowDepthID, "lightSpaceMatrix"), 1, GL_FALSE, &cascadeMatrices[c][0][0]);
+					CasterCullVolume volume = getCasterCullVolume(cascadeMatrices[c], glm::vec2(0.0f));
+					displayCasters(ShadowDepthID, CASTERS_DYNAMIC, &volume);
+				}
+			}
+			shadowUpdateStatus = staticDirty ? "static + dynamic" : dynamicDirty ? "dynamic" : "cached";
+		}
+
+		// the pyramid only follows the depth map when PCSS reads it
+		bool depthMapChanged = shadowUpdateMode == SHADOW_UPDATE_FULL || depthMapCache.lightChanged || staticDirty || dynamicDirty;
+		if (minMaxEnabled && (mode == 4 || mode == 8) && (depthMapChanged || !minMaxValid)) {
+			buildMinMaxPyramid();
+		}
+		else if (depthMapChanged) {
+			minMaxValid = false;
+		}
+	}
+	else {
+		// moment maps, two moments for VSSM, four quantized ones for MSM, exponential warps for ESM and EVSM
+		bool msm = mode == 6;
+		bool exponential = mode == 9 || mode == 10;
+		ShadowCache& momentCache = msm ? msmMapCache : exponential ? expMapCache : momentMapCache;
+		GLuint momentDepthID = msm ? MSMDepthID : exponential ? ExpDepthID : ShadowDepthID;
+		GLuint momentFBO = msm ? msmFBO : exponential ? expFBO : depthMapFBO2;
+		GLuint momentStaticFBO = msm ? msmStaticFBO : exponential ? expStaticFBO : staticMomentFBO;
+		if (exponential && expMapMode != mode) {
+			expMapMode = mode;
+			momentCache.valid = false;
+		}
+		bool staticDirty, dynamicDirty;
+		checkShadowCache(momentCache, &lightSpaceMatrix, 1, staticDirty, dynamicDirty);
+		glViewport(0, 0, 1024, 1024);
+		glUseProgram(momentDepthID);
+		// cleared to the moments of the far plane for MSM and to the warped far plane for ESM and EVSM
+		glm::vec3 exponents = getExponents();
+		if (msm) { glClearColor(1.0f, 0.99756f, 0.89344f, 0.0f); }
+		else if (mode == 9) { glClearColor(exp(exponents.x), 0.0f, 0.0f, 0.0f); }
+		else if (mode == 10) { glClearColor(exp(exponents.y), exp(2.0f * exponents.y), -exp(-exponents.z), exp(-2.0f * exponents.z)); }
+		else { glClearColor(0.5f, 0.5f, 0.5f, 1.0f); }
+		if (exponential) {
+			glUniform1i(glGetUniformLocation(momentDepthID, "evsm"), mode == 10);
+			glUniform3fv(glGetUniformLocation(momentDepthID, "exponents"), 1, &exponents[0]);
+		}
+		glEnable(GL_DEPTH_TEST);
+		glUniformMatrix4fv(glGetUniformLocation(momentDepthID, "lightSpaceMatrix"), 1, GL_FALSE, &lightSpaceMatrix[0][0]);
+		CasterCullVolume volume = getCasterCullVolume(lightSpaceMatrix, shadowUpdateMode == SHADOW_UPDATE_FULL ? glm::vec2(viewNear, camera_far) : glm::vec2(0.0f));
+
+		// partial updates are not done for the moments, the blur spreads every change anyway
+		if (shadowUpdateMode == SHADOW_UPDATE_FULL) {
+			glBindFramebuffer(GL_FRAMEBUFFER, momentFBO);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			displayCasters(momentDepthID, CASTERS_ALL, &volume);
+			shadowUpdateStatus = "full";
+		}
+		else {
+			if (staticDirty) {
+				glBindFramebuffer(GL_FRAMEBUFFER, momentStaticFBO);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				displayCasters(momentDepthID, CASTERS_STATIC, &volume);
+			}
+			if (staticDirty || dynamicDirty) {
+				// the moments keep their depth buffer, so dynamic casters depth test against the copy
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, momentStaticFBO);
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, momentFBO);
+				glBlitFramebuffer(0, 0, 1024, 1024, 0, 0, 1024, 1024, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+				glBindFramebuffer(GL_FRAMEBUFFER, momentFBO);
+				displayCasters(momentDepthID, CASTERS_DYNAMIC, &volume);
+			}
+			shadowUpdateStatus = staticDirty ? "static + dynamic" : dynamicDirty ? "dynamic" : "cached";
+		}
+
+		// calculate the average value, the blurred moments are cached along with the map
+		if (satEnabled && !msm) {
+			if (shadowUpdateMode == SHADOW_UPDATE_FULL || staticDirty || dynamicDirty) {
+				buildMomentSAT();
+			}
+		}
+		else if (shadowUpdateMode == SHADOW_UPDATE_FULL || staticDirty || dynamicDirty) {
+			GLuint* blurFBO = msm ? msmBlurFBO : exponential ? expBlurFBO : varianceFBO;
+			GLuint* blurTexture = msm ? msmBlurTexture : exponential ? expBlurTexture : varianceTexture;
+			GLenum blurFormat = msm ? GL_RGBA16 : exponential ? (expPrecision32 ? GL_RGBA32F : GL_RGBA16F) : GL_RG32F;
+			blurMomentMap(msm ? msmMap : exponential ? expMap : depthMap2, blurFBO, blurTexture, blurFormat);
+			// prefiltered, so the whole chain can be filtered trilinearly
+			if (exponential) {
+				glBindTexture(GL_TEXTURE_2D, expBlurTexture[1]);
+				glGenerateMipmap(GL_TEXTURE_2D);
+			}
+		}
+		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+	}
+
+	markGpuTimer(GPU_TIMER_SHADOWS);
+	// spot light shadows, all in one atlas
+	updateShadowAtlas();
+	if (atlasLightCount > 0) {
+		renderShadowAtlas();
+	}
+	if (pointLightCount > 0 && pointShadowsSupported) {
+		renderPointShadows();
+	}
+
+	markGpuTimer(GPU_TIMER_LIGHTS);
+	bool penumbraMaskActive = usesPenumbraMask();
+	if (penumbraMaskActive) {
+		renderPenumbraMask();
+	}
+
+	// 2. render scene
+	bool countPCF = (mode == 3 || mode == 4) && adaptivePCFEnabled && pcfCountersEnabled;
+	if (countPCF) {
+		GLuint zero[3] = { 0, 0, 0 };
+		glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, pcfCounterBuffer);
+		glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(zero), zero);
+	}
+	bindShadowTextures(penumbraMaskActive);
+	bool screenMaskActive = screenShadowMaskEnabled || temporalShadowsEnabled;
+	bool prePassActive = depthPrePassEnabled || screenMaskActive || hiZEnabled || occlusionQueriesEnabled;
+	cullHiZ();
+	updateOcclusionQueries();
+	if (prePassActive) {
+		renderDepthPrePass();
+	}
+	if (screenMaskActive) {
+		renderScreenShadowMask(penumbraMaskActive, countPCF);
+	}
+	markGpuTimer(GPU_TIMER_PREPASS);
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+	glViewport(0, 0, 1600, 1200);
+	if (prePassActive) {
+		// depth is already laid down, only the visible surface passes
+		glClear(GL_COLOR_BUFFER_BIT);
+		glDepthFunc(GL_LEQUAL);
+		glDepthMask(GL_FALSE);
+	}
+	else {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+	glUseProgram(ShadowID);
+	setShadowUniforms(ShadowID, penumbraMaskActive, countPCF);
+	glUniform1i(glGetUniformLocation(ShadowID, "useScreenShadowMask"), screenMaskActive);
+	displayScene(ShadowID, CULL_PASS_LIT);
+	endGpuTimers();
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	// debug only, reading the counters back waits for the lit pass
+	if (countPCF) {
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(pcfCounts), pcfCounts);
+		glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, 0);
+	}
+
+	// 3. visible depth range for the next frame's splits
+	if (sdsmEnabled) {
+		reduceSceneDepth();
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, 1600, 1200);
+
+	if (mode == 1) { drawText("Basic Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
+	else if (mode == 2) { drawText("Basic Shadow with bias", 5, glm::vec3(10.0f, 4.0f, 0.0f)); }
+	else if (mode == 3) { drawText("PCF Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
+	else if (mode == 4) { drawText("PCSS Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
+	else if (mode == 5) { drawText("VSSM Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
+	else if (mode == 6) { drawText("MSM Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
+	else if (mode == 7) { drawText("Hardware PCF Shadow", 5, glm::vec3(10.0f, 4.0f, 0.0f)); }
+	else if (mode == 8) { drawText("Gather PCSS Shadow", 5, glm::vec3(10.0f, 4.0f, 0.0f)); }
+	else if (mode == 9) { drawText("ESM Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
+	else if (mode == 10) { drawText("EVSM Shadow", 5, glm::vec3(11.0f, 4.0f, 0.0f)); }
+	std::string status;
+	// taps per cascade lookup, mode 3 is 11x11 manual taps, mode 7 a weighted kernel of bilinear compares
+	if ((mode == 3 || mode == 4) && samplePattern != SAMPLE_GRID) {
+		status += (samplePattern == SAMPLE_POISSON ? "Poisson " : "Vogel ") + to_string(sampleCounts[sampleCountIndex]) + " samples  ";
+	}
+	else if (mode == 3 && adaptivePCFEnabled) {
+		// radius 1 to ADAPTIVE_MAX_RADIUS, the full kernel only runs where the probes disagree
+		int taps = (2 * ADAPTIVE_MAX_RADIUS + 1) * (2 * ADAPTIVE_MAX_RADIUS + 1);
+		status += "PCF r 1-" + to_string(ADAPTIVE_MAX_RADIUS) + ", " + to_string(ADAPTIVE_PROBES) + " probes + up to " + to_string(taps) + " taps  ";
+	}
+	else if (mode == 4 && adaptivePCFEnabled) {
+		// 11x11 blocker search, then the probes and a filter of up to ADAPTIVE_MAX_PENUMBRA texels
+		int taps = (2 * ADAPTIVE_MAX_PENUMBRA + 1) * (2 * ADAPTIVE_MAX_PENUMBRA + 1);
+		status += "PCSS 121 search + " + to_string(ADAPTIVE_PROBES) + " probes + up to " + to_string(taps) + " taps  ";
+	}
+	else if (mode == 3) { status += "PCF 121 taps  "; }
+	else if (mode == 4) { status += "PCSS up to 242 fetches  "; }
+	else if (mode == 8) { status += "PCSS up to 32 gathers  "; }
+	else if (mode == 7) { status += "PCF " + to_string(pcfKernelSize) + "x" + to_string(pcfKernelSize) + ", " + to_string((pcfKernelSize + 1) / 2 * ((pcfKernelSize + 1) / 2)) + " taps  "; }
+	if ((mode == 3 || mode == 4) && adaptivePCFEnabled) {
+		status += "Adaptive PCF  ";
+		GLuint lookups = pcfCounts[0] + pcfCounts[1] + pcfCounts[2];
+		if (countPCF && lookups > 0) {
+			char countText[96];
+			snprintf(countText, sizeof(countText), "lit %.0f%% / shadowed %.0f%% / full kernel %.0f%%  ",
+				100.0f * pcfCounts[0] / lookups, 100.0f * pcfCounts[1] / lookups, 100.0f * pcfCounts[2] / lookups);
+			status += countText;
+		}
+	}
+	char gpuTimes[96];
+	snprintf(gpuTimes, sizeof(gpuTimes), "GPU ms: shadows %.2f / lights %.2f / pre-pass %.2f / lit %.2f  ",
+		gpuPassTimes[0], gpuPassTimes[1], gpuPassTimes[2], gpuPassTimes[3]);
+	status += gpuTimes;
+	if (cascadeCount > 1 && !isMomentMode()) { status += "Cascades: " + to_string(cascadeCount) + "  "; }
+	if (sdsmEnabled) { status += "SDSM  "; }
+	if (mode == 5 && satEnabled) { status += "SAT contact hardening  "; }
+	else if (isMomentMode()) { status += (computeBlurEnabled ? "Compute blur r=" : "Fragment blur r=") + to_string(blurRadius) + "  "; }
+	if (mode == 9 || mode == 10) {
+		glm::vec3 exponents = getExponents();
+		char expText[64];
+		if (mode == 9) { snprintf(expText, sizeof(expText), "c = %.1f, %d bit  ", exponents.x, expPrecision32 ? 32 : 16); }
+		else { snprintf(expText, sizeof(expText), "c = %.1f / %.1f, %d bit  ", exponents.y, exponents.z, expPrecision32 ? 32 : 16); }
+		status += expText;
+	}
+	if (minMaxEnabled && (mode == 4 || mode == 8)) { status += "Min/max early out  "; }
+	if (penumbraMaskActive) { status += "Penumbra mask, dilation " + to_string(penumbraDilation) + " tiles  "; }
+	if (screenMaskActive) { status += screenShadowMaskHalfRes ? "Deferred shadows, half res  " : "Deferred shadows  "; }
+	if (temporalShadowsEnabled) { status += (mode == 3 || mode == 4) ? "Temporal, 8 taps per frame  " : "Temporal  "; }
+	else if (prePassActive) { status += "Depth pre-pass  "; }
+	if (shadowUpdateMode != SHADOW_UPDATE_FULL) { status += "Shadow cache: " + shadowUpdateStatus + "  "; }
+	if (frustumCullingEnabled) {
+		CullCounters lit = getCullCounters(CULL_PASS_LIT);
+		status += "Objects: " + to_string(lit.drawn) + " drawn, " + to_string(lit.culled) + " culled  ";
+	}
+	if (hiZEnabled || occlusionQueriesEnabled) {
+		CullCounters lit = getCullCounters(CULL_PASS_LIT);
+		status += "Conditional draws: " + to_string(lit.retested) + "  ";
+	}
+	if (occlusionQueriesEnabled) { status += "Occlusion queries: " + to_string(occlusionQueriesIssued) + " issued, " + to_string(occlusionHidden) + " hidden  "; }
+	if (casterCullingEnabled) { status += "Casters: " + to_string(castersDrawn) + " drawn, " + to_string(castersCulled) + " culled  "; }
+	if (atlasLightCount > 0) { status += "Spot lights: " + to_string(atlasLightCount) + "  "; }
+	if (atlasUnshadowedLights > 0) { status += "Atlas full, " + to_string(atlasUnshadowedLights) + " spot lights unshadowed  "; }
+	if (pointLightCount > 0 && pointShadowsSupported) { status += "Point lights: " + to_string(pointLightCount) + " (" + to_string(pointFacesDrawn) + " faces)  "; }
+	else if (pointLightCount > 0) { status += "Point lights: " + to_string(pointLightCount) + " unshadowed, no cube map arrays  "; }
+	if (!status.empty()) { drawText(status.c_str(), 3, glm::vec3(11.0f, 3.3f, 0.0f)); }
+	glutPostRedisplay();
+	glutSwapBuffers();
+}
+
+void init()
+{
+	mesh_teapot = load_mesh(MESH_TEAPOT);
+	mesh_bunny = load_mesh(MESH_BUNNY);
+	mesh_square = load_mesh(MESH_SQUARE);
+	mesh_board = load_mesh(MESH_BOARD);
+	sceneObjects.push_back({ &mesh_teapot, glm::vec3(0.0f, -0.5f, 2.5f), 1, 0.2f, false, glm::vec3(0.0f, -0.5f, 2.5f) });
+	sceneObjects.push_back({ &mesh_bunny, glm::vec3(0.0f, -1.0f, -3.0f), 2, 1.0f, false, glm::vec3(0.0f, -1.0f, -3.0f) });
+	sceneObjects.push_back({ &mesh_teapot, glm::vec3(-3.0f, -1.0f, 0.0f), 1, 0.1f, true, glm::vec3(-3.0f, -1.0f, 0.0f) });
+	//sceneObjects.push_back({ &mesh_bunny, glm::vec3(-5.0f, -1.0f, -3.0f), 2, 0.5f, false, glm::vec3(-5.0f, -1.0f, -3.0f) });
+	sceneObjects.push_back({ &mesh_board, glm::vec3(-5.0f, -2.0f, 0.0f), 2, 0.2f, false, glm::vec3(-5.0f, -2.0f, 0.0f) });
+	brickWallMap = loadTexture("./textures/brickwall.jpg");
+	SkyBoxID = CompileShaders("./shaders/skyboxVertexShader.txt", "./shaders/skyboxFragmentShader.txt");
+	ShadowDepthID = CompileShaders("./shaders/shadowDepthVertexShader.txt", "./shaders/shadowDepthFragmentShader.txt");
+	// decides whether the lit programs are built with POINT_SHADOWS
+	pointShadowsSupported = GLEW_VERSION_4_0 || GLEW_ARB_texture_cube_map_array;
+	ShadowMapID = CompileLitProgram("./shaders/shadowFragmentShader.txt");
+	BiasID = CompileLitProgram("./shaders/shadowBiasFragmentShader.txt");
+	for (int v = 0; v < SAMPLE_VARIANTS; v++) {
+		std::string defines = "#define SAMPLE_COUNT " + to_string(sampleCounts[v]) + "\n";
+		PCFVariants[v] = CompileLitProgram("./shaders/shadowPCFFragmentShader.txt", defines.c_str());
+		PCSSVariants[v] = CompileLitProgram("./shaders/shadowPCSSFragmentShader.txt", defines.c_str());
+	}
+	PCFID = PCFVariants[sampleCountIndex];
+	PCSSID = PCSSVariants[sampleCountIndex];
+	VarianceID = CompileShaders("./shaders/shadowDD2VertexShader.txt", "./shaders/shadowDD2FragmentShader.txt");
+	VSSMID = CompileLitProgram("./shaders/shadowVSSMFragmentShader.txt");
+	MSMID = CompileLitProgram("./shaders/shadowMSMFragmentShader.txt");
+	HWPCFID = CompileLitProgram("./shaders/shadowHWPCFFragmentShader.txt");
+	GatherPCSSID = CompileLitProgram("./shaders/shadowGatherPCSSFragmentShader.txt");
+	ESMID = CompileLitProgram("./shaders/shadowESMFragmentShader.txt");
+	// compute shaders and image stores need GL 4.3, older drivers keep the fragment blur
+	computeBlurSupported = GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_image_load_store);
+	if (computeBlurSupported) {
+		BlurComputeID = CompileComputeShader("./shaders/shadowBlurComputeShader.txt");
+		glUseProgram(BlurComputeID);
+		glUniform1i(glGetUniformLocation(BlurComputeID, "source"), 0);
+		glUniform1i(glGetUniformLocation(BlurComputeID, "target"), 0);
+		computeBlurEnabled = true;
+	}
+	DepthReduceID = CompileShaders("./shaders/shadowDD2VertexShader.txt", "./shaders/shadowDepthReduceFragmentShader.txt");
+	MinMaxID = CompileShaders("./shaders/shadowDD2VertexShader.txt", "./shaders/shadowMinMaxFragmentShader.txt");
+	SATID = CompileShaders("./shaders/shadowDD2VertexShader.txt", "./shaders/shadowSATFragmentShader.txt");
+	PenumbraMaskID = CompileShaders("./shaders/shadowVertexShader.txt", "./shaders/shadowPenumbraMaskFragmentShader.txt");
+	PenumbraDilateID = CompileShaders("./shaders/shadowDD2VertexShader.txt", "./shaders/shadowPenumbraDilateFragmentShader.txt");
+	DepthPrePassID = CompileShaders("./shaders/shadowVertexShader.txt", "./shaders/shadowDepthFragmentShader.txt", NULL, "#define DEPTH_ONLY\n");
+	MaskUpsampleID = CompileShaders("./shaders/shadowDD2VertexShader.txt", "./shaders/shadowMaskUpsampleFragmentShader.txt");
+	TemporalID = CompileShaders("./shaders/shadowDD2VertexShader.txt", "./shaders/shadowTemporalFragmentShader.txt");
+	HiZID = CompileShaders("./shaders/shadowDD2VertexShader.txt", "./shaders/shadowHiZFragmentShader.txt");
+	HiZTestID = CompileShaders("./shaders/shadowDD2VertexShader.txt", "./shaders/shadowHiZTestFragmentShader.txt");
+	MSMDepthID = CompileShaders("./shaders/shadowDepthVertexShader.txt", "./shaders/shadowMSMDepthFragmentShader.txt");
+	ExpDepthID = CompileShaders("./shaders/shadowDepthVertexShader.txt", "./shaders/shadowExpDepthFragmentShader.txt");
+	if (pointShadowsSupported) {
+		PointDepthID = CompileShaders("./shaders/shadowPointDepthVertexShader.txt", "./shaders/shadowPointDepthFragmentShader.txt", "./shaders/shadowPointDepthGeometryShader.txt");
+	}
+	ShadowID = ShadowMapID;
+	std::vector<GLuint> litPrograms = { ShadowMapID, BiasID, VSSMID, MSMID, HWPCFID, GatherPCSSID, ESMID };
+	litPrograms.insert(litPrograms.end(), PCFVariants, PCFVariants + SAMPLE_VARIANTS);
+	litPrograms.insert(litPrograms.end(), PCSSVariants, PCSSVariants + SAMPLE_VARIANTS);
+	for (GLuint ID : litPrograms) {
+		setupLitProgram(ID);
+		setupLitProgram(screenMaskPrograms[ID]);
+	}
+	generateBlueNoise();
+	updateSamplePatterns();
+	createSpotLights();
+	createPointLights();
+	generateDepthMap();
+	generateVarianceMap();
+	generateShadowCache();
+	generateShadowAtlas();
+	if (pointShadowsSupported) {
+		generatePointShadowMaps();
+	}
+	generateShadowSampler();
+	generateMinMaxPyramid();
+	generateMomentSAT();
+	generateMomentShadowMap();
+	generateExponentialShadowMap();
+	generateSceneFBO();
+	generatePenumbraMask();
+	generateScreenShadowMask();
+	generateDepthReduction();
+	generateHiZ();
+	generateOcclusionBox();
+}
+
+// Placeholder code for the keypress
+void keypress(unsigned char key, int x, int y) {
+	if (key == '1') {
+		ShadowID = ShadowMapID;
+		mode = 1;
+	}
+	else if (key == '2') {
+		ShadowID = BiasID;
+		mode = 2;
+	}
+	else if (key == '3') {
+		ShadowID = PCFID;
+		mode = 3;
+	}
+	else if (key == '4') {
+		ShadowID = PCSSID;
+		mode = 4;
+	}
+	else if (key == '5') {
+		ShadowID = VSSMID;
+		mode = 5;
+	}
+	else if (key == '6') {
+		ShadowID = MSMID;
+		mode = 6;
+	}
+	else if (key == '7') {
+		ShadowID = HWPCFID;
+		mode = 7;
+	}
+	else if (key == '8') {
+		ShadowID = GatherPCSSID;
+		mode = 8;
+	}
+	else if (key == 'v') {
+		// VSSM from the summed-area table or from the fixed blur
+		satEnabled = !satEnabled;
+		momentMapCache.valid = false;
+	}
+	else if (key == 'x') {
+		// depth pre-pass, screen-space shadow mask, then the lit pass
+		screenShadowMaskEnabled = !screenShadowMaskEnabled;
+	}
+	else if (key == 't') {
+		// temporal accumulation on top of the screen-space shadow mask
+		temporalShadowsEnabled = !temporalShadowsEnabled;
+		temporalHistoryValid = false;
+	}
+	else if (key == 'o') {
+		// bounding box occlusion queries for the heavy meshes, needs the depth pre-pass
+		occlusionQueriesEnabled = !occlusionQueriesEnabled;
+	}
+	else if (key == 'w') {
+		// hierarchical-z occlusion culling, needs the depth pre-pass
+		hiZEnabled = !hiZEnabled;
+		hiZValid = false;
+		hiZPending[0] = hiZPending[1] = false;
+	}
+	else if (key == 'y') {
+		// camera frustum culling of the lit pass and the passes before it
+		frustumCullingEnabled = !frustumCullingEnabled;
+	}
+	else if (key == 'f') {
+		// cull shadow casters per light volume
+		casterCullingEnabled = !casterCullingEnabled;
+	}
+	else if (key == 'i') {
+		// camera depth pre-pass before the forward lit pass
+		depthPrePassEnabled = !depthPrePassEnabled;
+	}
+	else if (key == 'z') {
+		// shadow mask at half resolution with a bilateral upsample
+		screenShadowMaskHalfRes = !screenShadowMaskHalfRes;
+	}
+	else if (key == 'm') {
+		// penumbra mask pre-pass for PCSS, VSSM and MSM
+		penumbraMaskEnabled = !penumbraMaskEnabled;
+	}
+	else if (key == 'h') {
+		// min/max pyramid early out for PCSS
+		minMaxEnabled = !minMaxEnabled;
+	}
+	else if (key == '9') {
+		ShadowID = ESMID;
+		mode = 9;
+	}
+	else if (key == '0') {
+		ShadowID = ESMID;
+		mode = 10;
+	}
+	else if (key == 'e') {
+		// 16 or 32 bit float storage for ESM and EVSM
+		expPrecision32 = !expPrecision32;
+		allocateExponentialMaps();
+	}
+	else if (key == '+' || key == '-') {
+		// scale the exponents of the current mode and precision, within what the storage holds
+		glm::vec3& exponents = expExponents[expPrecision32];
+		float factor = key == '+' ? 1.25f : 0.8f;
+		if (mode == 10) {
+			exponents.y *= factor;
+			exponents.z *= factor;
+		}
+		else {
+			exponents.x *= factor;
+		}
+		exponents = glm::clamp(exponents, glm::vec3(EXP_MIN_EXPONENT), getMaxExponents());
+		expMapCache.valid = false;
+	}
+	else if (key == 'g') {
+		// compute or fragment moment blur
+		computeBlurEnabled = computeBlurSupported && !computeBlurEnabled;
+		momentMapCache.valid = false;
+		msmMapCache.valid = false;
+		expMapCache.valid = false;
+	}
+	else if (key == '[' || key == ']') {
+		// moment blur radius
+		blurRadius = glm::clamp(blurRadius + (key == ']' ? 1 : -1), 1, MAX_BLUR_RADIUS);
+		momentMapCache.valid = false;
+		msmMapCache.valid = false;
+		expMapCache.valid = false;
+	}
+	else if (key == 's') {
+		// PCF and PCSS sampling: square grid, Poisson disk or Vogel disk
+		samplePattern = (samplePattern + 1) % 3;
+		updateSamplePatterns();
+	}
+	else if (key == 'n') {
+		// 8, 16 or 32 disk samples
+		sampleCountIndex = (sampleCountIndex + 1) % SAMPLE_VARIANTS;
+		updateSamplePatterns();
+	}
+	else if (key == 'j') {
+		// adaptive PCF and PCSS filtering
+		adaptivePCFEnabled = !adaptivePCFEnabled;
+	}
+	else if (key == 'b') {
+		// count early-out and full kernel lookups in the lit pass
+		pcfCountersEnabled = pcfCountersSupported && !pcfCountersEnabled;
+	}
+	else if (key == 'k') {
+		// hardware PCF kernel 3x3, 5x5 or 7x7
+		pcfKernelSize = pcfKernelSize == 7 ? 3 : pcfKernelSize + 2;
+	}
+	else if (key == 'c') {
+		// cycle 1 (single map) to MAX_CASCADES cascades
+		cascadeCount = cascadeCount % MAX_CASCADES + 1;
+	}
+	else if (key == 'l') {
+		// 0, 4, 16 or 32 extra shadowed spot lights
+		atlasLightCount = atlasLightCount == 0 ? 4 : atlasLightCount == 4 ? 16 : atlasLightCount == 16 ? MAX_ATLAS_LIGHTS : 0;
+	}
+	else if (key == 'p') {
+		// 0, 1, 2 or 4 shadowed point lights
+		pointLightCount = pointLightCount == 0 ? 1 : pointLightCount == 1 ? 2 : pointLightCount == 2 ? MAX_POINT_LIGHTS : 0;
+	}
+	else if (key == 'a') {
+		animateObjects = !animateObjects;
+	}
+	else if (key == 'u') {
+		// cycle full, cached and partial shadow map updates
+		shadowUpdateMode = (shadowUpdateMode + 1) % 3;
+		// the static layers are not kept up to date in the other modes
+		depthMapCache.valid = false;
+		momentMapCache.valid = false;
+		msmMapCache.valid = false;
+		expMapCache.valid = false;
+	}
+	else if (key == 'd') {
+		sdsmEnabled = !sdsmEnabled;
+		visibleDepthMin = visibleDepthMax = 0.0f;
+	}
+}
+
+void mousePress(int button, int state, int xpos, int ypos) {
+	// Wheel reports as button 3(scroll up) and button 4(scroll down)
+	if (button == 3) // It's a wheel event
+	{
+		// Each wheel event reports like a button click, GLUT_DOWN then GLUT_UP
+		if (state == GLUT_UP) return; // Disregard redundant GLUT_UP events
+		printf("Scroll %s At %d %d\n", (button == 3) ? "Up" : "Down", xpos, ypos);
+		camera_pos_x += 1.0f;
+	}
+	else if (button == 4)
+	{
+		if (state == GLUT_UP) return; // Disregard redundant GLUT_UP events
+		printf("Scroll %s At %d %d\n", (button == 3) ? "Up" : "Down", xpos, ypos);
+		camera_pos_x -= 1.0f;
+	}
+	else if (button == GLUT_RIGHT_BUTTON && state == GLUT_DOWN) {
+		// pick the nearest object box under the cursor
+		glm::mat4 invViewProj = glm::inverse(persp_proj * view);
+		glm::vec2 ndc = glm::vec2(2.0f * xpos / width - 1.0f, 1.0f - 2.0f * ypos / height);
+		glm::vec4 nearPoint = invViewProj * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+		glm::vec4 farPoint = invViewProj * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+		glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+		glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+		int hitObject;
+		float hitDistance;
+		if (sceneBVH.raycast(origin, direction, hitObject, hitDistance)) {
+			printf("Picked object %d at distance %.2f\n", hitObject, hitDistance);
+		}
+		else {
+			printf("Picked nothing\n");
+		}
+	}
+	else if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {  // normal button event
+		yaw += (xpos - float(width) / 2.0) / width;
+		yaw = glm::mod(yaw + 180.0f, 360.0f) - 180.0f;
+		pitch -= (ypos - float(height) / 2.0) / height;
+		pitch = glm::clamp(pitch, -89.0f, 89.0f);
+		//glutWarpPointer(width / 2.0, height / 2.0);	
+		camera_dir_x = cos(pitch) * sin(yaw);
+		camera_dir_y = sin(pitch);
+		camera_dir_z = -cos(pitch) * cos(yaw);
+	}
+}
+
+int main(int argc, char** argv) {
+	// Set up the window
+	glutInit(&argc, argv);
+	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+	glutInitWindowSize(width, height);
+	glutCreateWindow("shadow");
+
+	//texure
+	glEnable(GL_DEPTH_TEST);
+
+	// Tell glut where the display function is
+	glutDisplayFunc(display);
+	glutKeyboardFunc(keypress);
+	glutMouseFunc(mousePress);
+	//glutMotionFunc(mouseMotion);
+
+	// A call to glewInit() must be done after glut is initialized!
+	GLenum res = glewInit();
+	// Check for any errors
+	if (res != GLEW_OK) {
+		fprintf(stderr, "Error: '%s'\n", glewGetErrorString(res));
+		return 1;
+	}
+	// Set up your objects and shaders
+	init();
+	// Begin infinite event loop
+	glutMainLoop();
+	return 0;
 }
\ No newline at end of file